@@ -0,0 +1,70 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+/*
+  bench.h - measurement markers for the benchmark sketches
+
+  A sketch brackets the code under test with BENCH(id, statement).
+  The markers are single `out` writes to GPIOR0, which simbench
+  watches: an ID starts a measurement, 0 ends it, BENCH_DONE ends
+  the run.  The cost of an empty BENCH() is measured first and
+  subtracted from everything else.
+
+  Copyright (c) 2011 Applied Platonics.
+
+  This file is a part of the PlatoBoard, 
+  http://www.appliedplatonics.com/platoboard/
+
+  Distributed under the terms of the GPL.
+*/
+
+#ifndef Bench_h
+#define Bench_h
+
+#include <avr/io.h>
+
+enum {
+  BENCH_STOP = 0,
+#define BENCH_ID(sym, name) BENCH_##sym,
+#include "bench_ids.h"
+#undef BENCH_ID
+  BENCH_DONE = 0xFF
+};
+
+// The compiler may not move memory accesses or calls across a marker.
+#define BENCH_MARK(v) do {                      \
+    asm volatile ("" ::: "memory");             \
+    GPIOR0 = (v);                               \
+    asm volatile ("" ::: "memory");             \
+  } while (0)
+
+#define BENCH(sym, stmt) do {                   \
+    BENCH_MARK(BENCH_##sym);                    \
+    stmt;                                       \
+    BENCH_MARK(BENCH_STOP);                     \
+  } while (0)
+
+// Each measurement is taken this many times; simbench reports the
+// fastest and slowest run.
+#define BENCH_RUNS 4
+
+#define BENCH_REPEAT(sym, stmt) do {                    \
+    for (uint8_t _bench_i = 0; _bench_i < BENCH_RUNS; _bench_i++)  \
+      BENCH(sym, stmt);                                 \
+  } while (0)
+
+// Values read from here can't be folded into the code under test,
+// so they exercise the runtime (non-constant) paths.
+extern volatile uint8_t bench_var;
+
+static inline void bench_begin(void)
+{
+  BENCH_REPEAT(OVERHEAD, );
+}
+
+static inline void bench_end(void)
+{
+  BENCH_MARK(BENCH_DONE);
+  for (;;)
+    ;
+}
+
+#endif
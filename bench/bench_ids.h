@@ -0,0 +1,37 @@
+/* -*- mode: C; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+/*
+  bench_ids.h - measurement IDs shared by the benchmark sketches and
+  simbench.  Each BENCH_ID(sym, name) becomes BENCH_<sym> in the
+  sketches and a row called <name> in the results.
+
+  The order is the protocol: IDs are numbered from 1 in this order,
+  so add new ones at the end.
+
+  Copyright (c) 2011 Applied Platonics.
+
+  This file is a part of the PlatoBoard, 
+  http://www.appliedplatonics.com/platoboard/
+
+  Distributed under the terms of the GPL.
+*/
+
+BENCH_ID(OVERHEAD,           "overhead")
+BENCH_ID(PINMODE_CONST,      "pinMode(const)")
+BENCH_ID(PINMODE_VAR,        "pinMode(var)")
+BENCH_ID(DIGITALWRITE_CONST, "digitalWrite(const)")
+BENCH_ID(DIGITALWRITE_VAR,   "digitalWrite(var)")
+BENCH_ID(DIGITALREAD_CONST,  "digitalRead(const)")
+BENCH_ID(DIGITALREAD_VAR,    "digitalRead(var)")
+BENCH_ID(DIGITALTOGGLE_VAR,  "digitalToggle(var)")
+BENCH_ID(PORTWRITE,          "portWrite")
+BENCH_ID(PINGROUP_WRITE,     "PinGroup::write")
+BENCH_ID(ANALOGWRITE,        "analogWrite")
+BENCH_ID(MILLIS,             "millis")
+BENCH_ID(MICROS,             "micros")
+BENCH_ID(DELAYUS_CONST,      "delayMicroseconds(const)")
+BENCH_ID(DELAYUS_VAR,        "delayMicroseconds(var)")
+BENCH_ID(SERIAL_WRITE,       "TinySerial::write")
+BENCH_ID(PRINT_ULONG,        "Print::print(unsigned long)")
+BENCH_ID(PRINT_STR,          "Print::print(const char *)")
+BENCH_ID(SLIP_WRITE16,       "SlipWriter::write16")
+BENCH_ID(SLIP_FRAME,         "SlipWriter frame of 4 words")
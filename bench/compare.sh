@@ -0,0 +1,23 @@
+#!/bin/sh
+# compare.sh - show what changed between two results.tsv files
+#
+# usage: compare.sh baseline.tsv results.tsv
+#
+# Prints every row whose fastest cycle count or stack use went up,
+# and exits non-zero if there were any.
+
+awk -F '\t' '
+  NR == FNR { key = $1 FS $2 FS $3; cyc[key] = $5; stk[key] = $7; next }
+  FNR == 1 { next }
+  {
+    key = $1 FS $2 FS $3
+    if (!(key in cyc)) { printf "new\t%s\t%s cycles\n", key, $5; next }
+    if ($5 > cyc[key] || $7 > stk[key]) {
+      printf "worse\t%s\t%s -> %s cycles, %s -> %s stack\n", key, cyc[key], $5, stk[key], $7
+      bad = 1
+    } else if ($5 < cyc[key]) {
+      printf "better\t%s\t%s -> %s cycles\n", key, cyc[key], $5
+    }
+  }
+  END { exit bad }
+' "$1" "$2"
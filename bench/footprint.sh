@@ -0,0 +1,33 @@
+#!/bin/sh
+# footprint.sh - flash/RAM per sketch and per core symbol, as TSV
+#
+# usage: footprint.sh mcu builddir [mcu builddir ...]
+#
+#   mcu  sketch  flash  ram          one row per <sketch>.elf
+#   mcu  core    <symbol>  <bytes>   one row per sized core.a symbol
+
+SIZE=${SIZE:-avr-size}
+NM=${NM:-avr-nm}
+
+printf 'mcu\tsketch\tflash\tram\n'
+while [ $# -ge 2 ]; do
+  mcu=$1; dir=$2; shift 2
+
+  for elf in $dir/*.elf; do
+    $SIZE $elf | awk -v mcu=$mcu -v s=$(basename $elf .elf) \
+      'NR == 2 { printf "%s\t%s\t%d\t%d\n", mcu, s, $1 + $2, $2 + $3 }'
+  done
+
+  $NM -S -C --defined-only $dir/core.a | \
+    awk -v mcu=$mcu '
+      function hex(s,  n, i) {
+        n = 0
+        for (i = 1; i <= length(s); i++)
+          n = n * 16 + index("0123456789abcdef", tolower(substr(s, i, 1))) - 1
+        return n
+      }
+      NF >= 4 && $3 ~ /^[TtDdBbRr]$/ {
+        name = $4; for (i = 5; i <= NF; i++) name = name " " $i
+        printf "%s\tcore\t%s\t%d\n", mcu, name, hex($2)
+      }'
+done
@@ -0,0 +1,47 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+/*
+  gpio.cpp - digital I/O benchmarks
+*/
+
+#include <WProgram.h>
+#include "bench.h"
+
+// A plain pin (no timer) and a PWM pin on each part.
+#if defined(__AVR_ATtiny2313__)
+#define BENCH_PIN 12
+#define BENCH_PWM_PIN 10
+#else
+#define BENCH_PIN 3
+#define BENCH_PWM_PIN 0
+#endif
+
+volatile uint8_t bench_var = BENCH_PIN;
+
+PinGroup group(BENCH_PIN, BENCH_PIN + 1);
+
+void setup()
+{
+  uint8_t p = bench_var;
+
+  bench_begin();
+
+  BENCH_REPEAT(PINMODE_CONST, pinMode(BENCH_PIN, OUTPUT));
+  BENCH_REPEAT(PINMODE_VAR, pinMode(p, OUTPUT));
+  BENCH_REPEAT(DIGITALWRITE_CONST, digitalWrite(BENCH_PIN, HIGH));
+  BENCH_REPEAT(DIGITALWRITE_VAR, digitalWrite(p, HIGH));
+  BENCH_REPEAT(DIGITALREAD_CONST, digitalRead(BENCH_PIN));
+  BENCH_REPEAT(DIGITALREAD_VAR, digitalRead(p));
+  BENCH_REPEAT(DIGITALTOGGLE_VAR, digitalToggle(p));
+  BENCH_REPEAT(PORTWRITE, portWrite(PB, p));
+
+  group.output();
+  BENCH_REPEAT(PINGROUP_WRITE, group.write(p));
+
+  BENCH_REPEAT(ANALOGWRITE, analogWrite(BENCH_PWM_PIN, p));
+
+  bench_end();
+}
+
+void loop()
+{
+}
@@ -0,0 +1,38 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+/*
+  serial.cpp - TinySerial, Print and SlipWriter benchmarks (ATtiny2313 only).
+  The slowest run of each includes waiting for the UART.
+*/
+
+#include <WProgram.h>
+#include "bench.h"
+
+volatile uint8_t bench_var = 'x';
+
+SlipWriter slip(Serial);
+
+void setup()
+{
+  uint8_t c = bench_var;
+
+  Serial.begin(115200);
+
+  bench_begin();
+
+  BENCH_REPEAT(SERIAL_WRITE, Serial.write(c));
+  BENCH_REPEAT(PRINT_ULONG, Serial.print(1234567UL));
+  BENCH_REPEAT(PRINT_STR, Serial.print("bench"));
+  BENCH_REPEAT(SLIP_WRITE16, slip.write16(1234));
+  BENCH_REPEAT(SLIP_FRAME, {
+      slip.begin();
+      for (uint8_t i = 0; i < 4; i++)
+        slip.write16(1234);
+      slip.end();
+    });
+
+  bench_end();
+}
+
+void loop()
+{
+}
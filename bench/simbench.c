@@ -0,0 +1,255 @@
+/* -*- mode: C; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+/*
+  simbench.c - run a benchmark sketch under simavr and report what
+  each BENCH() section and each interrupt handler cost.
+
+  usage: simbench -m mcu -f f_cpu [-n sketch] [-c max_cycles] file.elf
+
+  One tab-separated row per measurement on stdout:
+
+    mcu  sketch  name  calls  cycles_min  cycles_max  stack
+
+  cycles are CPU cycles with the marker overhead subtracted and any
+  interrupt handler that ran in the middle taken out; stack is the
+  deepest the stack went below where it started, in bytes.  Interrupt
+  handlers get an "isr:<vector>" row, counted from the vector to the
+  end of reti, with stack including the pushed return address.
+
+  Copyright (c) 2011 Applied Platonics.
+
+  This file is a part of the PlatoBoard,
+  http://www.appliedplatonics.com/platoboard/
+
+  Distributed under the terms of the GPL.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_io.h>
+
+#define BENCH_STOP 0
+#define BENCH_DONE 0xFF
+
+static const char *bench_names[] = {
+  "stop",
+#define BENCH_ID(sym, name) name,
+#include "bench_ids.h"
+#undef BENCH_ID
+};
+#define NUM_BENCH_IDS (sizeof(bench_names) / sizeof(bench_names[0]))
+
+struct mcu_info {
+  const char *name;
+  uint16_t gpior0;              // data-space address
+  uint8_t vector_size;          // bytes per vector table slot
+  uint8_t num_vectors;          // slots in the table, reset included
+  const char *vectors[20];      // by vector number, 0 = reset
+};
+
+static const struct mcu_info mcus[] = {
+  { "attiny2313", 0x13 + 0x20, 2, 19,
+    { "RESET", "INT0", "INT1", "TIMER1_CAPT", "TIMER1_COMPA",
+      "TIMER1_OVF", "TIMER0_OVF", "USART_RX", "USART_UDRE", "USART_TX",
+      "ANA_COMP", "PCINT", "TIMER1_COMPB", "TIMER0_COMPA", "TIMER0_COMPB",
+      "USI_START", "USI_OVERFLOW", "EE_READY", "WDT_OVERFLOW" } },
+  { "attiny45", 0x11 + 0x20, 2, 15,
+    { "RESET", "INT0", "PCINT0", "TIM1_COMPA", "TIM1_OVF", "TIM0_OVF",
+      "EE_RDY", "ANA_COMP", "ADC", "TIM1_COMPB", "TIM0_COMPA",
+      "TIM0_COMPB", "WDT", "USI_START", "USI_OVF" } },
+  { "attiny85", 0x11 + 0x20, 2, 15,
+    { "RESET", "INT0", "PCINT0", "TIM1_COMPA", "TIM1_OVF", "TIM0_OVF",
+      "EE_RDY", "ANA_COMP", "ADC", "TIM1_COMPB", "TIM0_COMPA",
+      "TIM0_COMPB", "WDT", "USI_START", "USI_OVF" } },
+};
+
+struct stats {
+  unsigned long calls;
+  uint64_t min, max;
+  unsigned stack;
+};
+
+static struct stats bench_stats[NUM_BENCH_IDS];
+static struct stats isr_stats[20];
+
+// the open BENCH() section, if any
+static uint8_t open_id;
+static uint64_t open_start;
+static uint64_t open_isr_cycles;
+static uint16_t open_sp, open_min_sp;
+
+static int done;
+
+static uint16_t get_sp(avr_t *avr)
+{
+  return avr->data[R_SPL] | (avr->data[R_SPH] << 8);
+}
+
+static void record(struct stats *s, uint64_t cycles, unsigned stack)
+{
+  if (s->calls == 0 || cycles < s->min) s->min = cycles;
+  if (s->calls == 0 || cycles > s->max) s->max = cycles;
+  if (stack > s->stack) s->stack = stack;
+  s->calls++;
+}
+
+static void gpior0_write(avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param)
+{
+  (void) param;
+  avr->data[addr] = v;
+
+  if (v == BENCH_DONE) {
+    done = 1;
+    return;
+  }
+
+  if (open_id != BENCH_STOP) {
+    record(&bench_stats[open_id], avr->cycle - open_start - open_isr_cycles,
+           open_sp - open_min_sp);
+    open_id = BENCH_STOP;
+  }
+
+  if (v != BENCH_STOP && v < NUM_BENCH_IDS) {
+    open_id = v;
+    open_start = avr->cycle;
+    open_isr_cycles = 0;
+    open_sp = open_min_sp = get_sp(avr);
+  }
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: simbench -m mcu -f f_cpu [-n sketch] "
+          "[-c max_cycles] file.elf\n");
+  exit(2);
+}
+
+int main(int argc, char **argv)
+{
+  const char *mcu = NULL, *sketch = "-";
+  unsigned long f_cpu = 0;
+  uint64_t max_cycles = 0;
+  const struct mcu_info *info = NULL;
+  elf_firmware_t fw;
+  avr_t *avr;
+  unsigned i;
+  int opt;
+
+  int in_isr = 0;
+  unsigned isr_vector = 0;
+  uint64_t isr_start = 0;
+  uint16_t isr_sp = 0, isr_min_sp = 0;
+
+  while ((opt = getopt(argc, argv, "m:f:n:c:")) != -1) {
+    switch (opt) {
+    case 'm': mcu = optarg; break;
+    case 'f': f_cpu = strtoul(optarg, NULL, 0); break;
+    case 'n': sketch = optarg; break;
+    case 'c': max_cycles = strtoull(optarg, NULL, 0); break;
+    default: usage();
+    }
+  }
+  if (!mcu || !f_cpu || optind != argc - 1) usage();
+
+  for (i = 0; i < sizeof(mcus) / sizeof(mcus[0]); i++)
+    if (!strcmp(mcus[i].name, mcu)) info = &mcus[i];
+  if (!info) {
+    fprintf(stderr, "simbench: don't know the %s\n", mcu);
+    return 2;
+  }
+
+  // a second of simulated time is far more than any sketch needs
+  if (!max_cycles) max_cycles = f_cpu;
+
+  memset(&fw, 0, sizeof(fw));
+  if (elf_read_firmware(argv[optind], &fw) != 0) {
+    fprintf(stderr, "simbench: can't read %s\n", argv[optind]);
+    return 1;
+  }
+  strncpy(fw.mmcu, mcu, sizeof(fw.mmcu) - 1);
+  fw.frequency = f_cpu;
+
+  avr = avr_make_mcu_by_name(fw.mmcu);
+  if (!avr) {
+    fprintf(stderr, "simbench: simavr has no %s\n", mcu);
+    return 1;
+  }
+  avr_init(avr);
+  avr_load_firmware(avr, &fw);
+  avr->log = LOG_ERROR;
+
+  avr_register_io_write(avr, info->gpior0, gpior0_write, NULL);
+
+  while (!done) {
+    int state = avr_run(avr);
+
+    if (state == cpu_Done || state == cpu_Crashed) {
+      fprintf(stderr, "simbench: %s stopped before BENCH_DONE\n", sketch);
+      return 1;
+    }
+    if (avr->cycle > max_cycles) {
+      fprintf(stderr, "simbench: %s still running after %llu cycles\n",
+              sketch, (unsigned long long) max_cycles);
+      return 1;
+    }
+
+    uint16_t sp = get_sp(avr);
+
+    if (!in_isr) {
+      // Interrupt entry leaves the pc on a vector table slot.  The
+      // startup code follows straight after the table, so only the
+      // MCU's own slots count.
+      if (avr->pc != 0
+          && avr->pc < (unsigned) info->num_vectors * info->vector_size
+          && avr->pc % info->vector_size == 0) {
+        in_isr = 1;
+        isr_vector = avr->pc / info->vector_size;
+        isr_start = avr->cycle;
+        isr_sp = isr_min_sp = sp;
+      } else if (open_id != BENCH_STOP && sp < open_min_sp) {
+        open_min_sp = sp;
+      }
+    } else {
+      if (sp < isr_min_sp) isr_min_sp = sp;
+
+      // reti pops the return address back off
+      if (sp > isr_sp) {
+        uint64_t cycles = avr->cycle - isr_start;
+
+        record(&isr_stats[isr_vector], cycles, isr_sp - isr_min_sp + 2);
+        if (open_id != BENCH_STOP) open_isr_cycles += cycles;
+        in_isr = 0;
+      }
+    }
+  }
+
+  uint64_t overhead = bench_stats[1].calls ? bench_stats[1].min : 0;
+
+  for (i = 1; i < NUM_BENCH_IDS; i++) {
+    struct stats *s = &bench_stats[i];
+    if (!s->calls) continue;
+    if (i > 1) {
+      s->min = s->min > overhead ? s->min - overhead : 0;
+      s->max = s->max > overhead ? s->max - overhead : 0;
+    }
+    printf("%s\t%s\t%s\t%lu\t%llu\t%llu\t%u\n", mcu, sketch, bench_names[i],
+           s->calls, (unsigned long long) s->min,
+           (unsigned long long) s->max, s->stack);
+  }
+
+  for (i = 1; i < 20; i++) {
+    struct stats *s = &isr_stats[i];
+    if (!s->calls) continue;
+    printf("%s\t%s\tisr:%s\t%lu\t%llu\t%llu\t%u\n", mcu, sketch,
+           info->vectors[i] ? info->vectors[i] : "?", s->calls,
+           (unsigned long long) s->min, (unsigned long long) s->max,
+           s->stack);
+  }
+
+  return 0;
+}
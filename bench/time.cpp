@@ -0,0 +1,33 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+/*
+  time.cpp - timebase benchmarks.  The timer 0 overflow handler is
+  running the whole time, so its cost shows up in the ISR rows.
+*/
+
+#include <WProgram.h>
+#include "bench.h"
+
+volatile uint8_t bench_var = 10;
+
+volatile unsigned long sink;
+
+void setup()
+{
+  uint8_t us = bench_var;
+
+  bench_begin();
+
+  BENCH_REPEAT(MILLIS, sink = millis());
+  BENCH_REPEAT(MICROS, sink = micros());
+  BENCH_REPEAT(DELAYUS_CONST, delayMicroseconds(10));
+  BENCH_REPEAT(DELAYUS_VAR, delayMicroseconds(us));
+
+  // let a few dozen overflows go by for the ISR statistics
+  delay(50);
+
+  bench_end();
+}
+
+void loop()
+{
+}
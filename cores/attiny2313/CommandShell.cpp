@@ -0,0 +1,125 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+/*
+  CommandShell.cpp - Text commands off a Stream, looked up in flash
+
+  Copyright (c) 2011 Applied Platonics.
+
+  This file is a part of the PlatoBoard,
+  http://www.appliedplatonics.com/platoboard/
+
+  Distributed under the terms of the GPL.
+*/
+
+#include <inttypes.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+
+#include "CommandShell.h"
+
+CommandShell::CommandShell(Stream &in, const struct shell_command *table,
+                           uint8_t count, char *buf, uint8_t size)
+  : _in(in), _table(table), _count(count), _buf(buf), _size(size),
+    _len(0), _skip(0)
+{
+}
+
+// Binary search of the table in flash; 0 if name isn't there.
+const struct shell_command *CommandShell::lookup(const char *name)
+{
+  uint8_t lo = 0, hi = _count, mid;
+  int cmp;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    cmp = strcmp_P(name, _table[mid].name);
+    if (cmp == 0) return &_table[mid];
+    if (cmp < 0) hi = mid;
+    else lo = mid + 1;
+  }
+  return 0;
+}
+
+static inline uint8_t is_space(char c)
+{
+  return c == ' ' || c == '\t';
+}
+
+// Split line where it lies: the name gets a NUL after it and the
+// arguments are turned into ints as they're passed over.
+int8_t CommandShell::run(char *line)
+{
+  int argv[COMMAND_ARGS_MAX];
+  uint8_t argc = 0;
+  const struct shell_command *cmd;
+  char *name, *p = line;
+  bool negative;
+  int value;
+
+  while (is_space(*p)) p++;
+  name = p;
+  while (*p && !is_space(*p)) p++;
+  if (*p) *p++ = 0;
+  if (!*name) return COMMAND_NONE;
+
+  for (;;) {
+    while (is_space(*p)) p++;
+    if (!*p) break;
+    if (argc == COMMAND_ARGS_MAX) return COMMAND_BAD_ARGS;
+
+    negative = *p == '-';
+    if (negative) p++;
+    if (*p < '0' || *p > '9') return COMMAND_BAD_ARGS;
+    for (value = 0; *p >= '0' && *p <= '9'; p++)
+      value = value * 10 + *p - '0';
+    if (*p && !is_space(*p)) return COMMAND_BAD_ARGS;
+
+    argv[argc++] = negative ? -value : value;
+  }
+
+  cmd = lookup(name);
+  if (!cmd) return COMMAND_UNKNOWN;
+  ((commandHandler) pgm_read_word(&cmd->handler))(argc, argv);
+  return COMMAND_OK;
+}
+
+// Take what the Stream has, straight into the buffer, and run the
+// first complete line in it, if there is one.  Whatever came in after
+// that line stays in the buffer for the next call, so call this until
+// it returns COMMAND_NONE to catch up after a burst.  A line ends at
+// '\r' or '\n'; the other half of a "\r\n" makes a blank line, which
+// is skipped.
+int8_t CommandShell::poll(void)
+{
+  uint8_t i;
+  int8_t result;
+
+  if (_len < _size)
+    _len += _in.readAvailable((uint8_t *) _buf + _len, _size - _len);
+
+  for (i = 0; i < _len && _buf[i] != '\n' && _buf[i] != '\r'; i++)
+    ;
+
+  if (i == _len) {
+    if (_len < _size)
+      return COMMAND_NONE;
+    // full with no end in sight: drop it, and the rest of the line
+    // when it comes
+    _len = 0;
+    if (_skip) return COMMAND_NONE;
+    _skip = 1;
+    return COMMAND_TOO_LONG;
+  }
+
+  _buf[i] = 0;
+  if (_skip) {
+    _skip = 0;
+    result = COMMAND_NONE;
+  } else {
+    result = run(_buf);
+  }
+
+  i++;
+  _len -= i;
+  memmove(_buf, _buf + i, _len);
+  return result;
+}
@@ -0,0 +1,83 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+/*
+  CommandShell.h - Text commands off a Stream, looked up in flash
+
+  Copyright (c) 2011 Applied Platonics.
+
+  This file is a part of the PlatoBoard,
+  http://www.appliedplatonics.com/platoboard/
+
+  Distributed under the terms of the GPL.
+*/
+
+#ifndef CommandShell_h
+#define CommandShell_h
+
+#include <inttypes.h>
+#include <avr/pgmspace.h>
+#include "Stream.h"
+
+// Longest command name, with its NUL.
+#ifndef COMMAND_NAME_SIZE
+#define COMMAND_NAME_SIZE 8
+#endif
+
+// Most integer arguments a command line can carry.
+#ifndef COMMAND_ARGS_MAX
+#define COMMAND_ARGS_MAX 4
+#endif
+
+// What poll() returns.
+#define COMMAND_NONE 0          // no complete line yet, or a blank one
+#define COMMAND_OK 1            // a handler ran
+#define COMMAND_UNKNOWN -1      // no such command
+#define COMMAND_BAD_ARGS -2     // not a number, or too many
+#define COMMAND_TOO_LONG -3     // the line didn't fit the buffer
+
+typedef void (*commandHandler)(uint8_t argc, const int *argv);
+
+struct shell_command {
+  char name[COMMAND_NAME_SIZE];
+  commandHandler handler;
+};
+
+// Reads lines such as "led 1" or "pwm 3 -40" from a Stream into a
+// buffer the caller owns, splits them there, and calls the handler
+// from a table in flash with the arguments as ints.
+//
+//   const struct shell_command commands[] PROGMEM = {
+//     { "led", cmdLed },          // sorted by name, as strcmp() has it
+//     { "pwm", cmdPwm },
+//   };
+//   char line[16];
+//   CommandShell shell(Serial, commands, 2, line, sizeof(line));
+//
+//   void loop()
+//   {
+//     if (shell.poll() < 0)
+//       Serial.println("?");
+//   }
+//
+// The table is searched by halves, so it must be in order.  Nothing
+// is copied out of flash or allocated; the only RAM is the line
+// buffer and, while a handler runs, the arguments on the stack.
+class CommandShell
+{
+public:
+  CommandShell(Stream &in, const struct shell_command *table,
+               uint8_t count, char *buf, uint8_t size);
+  int8_t poll(void);
+private:
+  int8_t run(char *line);
+  const struct shell_command *lookup(const char *name);
+
+  Stream &_in;
+  const struct shell_command *_table;
+  uint8_t _count;
+  char *_buf;
+  uint8_t _size;
+  uint8_t _len;
+  uint8_t _skip;                // throwing away an over-long line
+};
+
+#endif // ndef CommandShell_h
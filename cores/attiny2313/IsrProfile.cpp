@@ -0,0 +1,48 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+/*
+  IsrProfile.cpp - Print what the ISR profiler has gathered
+
+  Copyright (c) 2011 Applied Platonics.
+
+  This file is a part of the PlatoBoard,
+  http://www.appliedplatonics.com/platoboard/
+
+  Distributed under the terms of the GPL.
+*/
+
+#include <inttypes.h>
+#include <avr/pgmspace.h>
+#include "wiring_private.h"
+
+#include "Print.h"
+
+#if ISR_PROFILE
+
+static const char isr_profile_names[ISR_PROF_COUNT][7] PROGMEM = {
+  "T0_OVF", "T0_CMP", "RX", "INT0", "TX", "TXC", "T1_CMP"
+};
+
+// One line per handler that has run:
+//   name count avg_cycles max_cycles max_latency_cycles
+void isrProfilePrint(Print &out)
+{
+  struct isr_profile p;
+  uint8_t id;
+
+  for (id = 0; id < ISR_PROF_COUNT; id++) {
+    isrProfileRead(id, &p);
+    if (!p.count) continue;
+
+    out.writePgm(isr_profile_names[id]);
+    out.print(' ');
+    out.print(p.count);
+    out.print(' ');
+    out.print(p.cycles / p.count);
+    out.print(' ');
+    out.print(p.max_cycles);
+    out.print(' ');
+    out.println(p.max_latency);
+  }
+}
+
+#endif
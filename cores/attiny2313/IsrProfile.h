@@ -0,0 +1,57 @@
+/* -*- mode: C; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+/*
+  IsrProfile.h - What the interrupt handler profiler has gathered
+
+  Copyright (c) 2011 Applied Platonics.
+
+  This file is a part of the PlatoBoard,
+  http://www.appliedplatonics.com/platoboard/
+
+  Distributed under the terms of the GPL.
+
+  Only filled in when the core is built with -DISR_PROFILE=1; see
+  wiring_profile.c.
+*/
+
+#ifndef IsrProfile_h
+#define IsrProfile_h
+
+#include <inttypes.h>
+
+#ifdef __cplusplus
+#include "Print.h"
+
+extern "C"{
+#endif
+
+  // isrProfileRead() handlers
+#define ISR_PROF_TIMER0_OVF 0
+#define ISR_PROF_TIMER0_COMPA 1   // tone()
+#define ISR_PROF_USART_RX 2
+#define ISR_PROF_INT0 3
+#define ISR_PROF_USART_UDRE 4
+#define ISR_PROF_USART_TX 5       // driverEnable()
+#define ISR_PROF_TIMER1_COMPB 6   // MODBUS_SLAVE
+#define ISR_PROF_COUNT 7
+
+  // What one handler has cost since the last isrProfileReset(), in CPU
+  // cycles; the average is cycles / count.
+  struct isr_profile {
+    unsigned int count;
+    unsigned long cycles;
+    unsigned int max_cycles;
+    unsigned int max_latency;
+  };
+
+  void isrProfileRead(uint8_t id, struct isr_profile *p);
+  void isrProfileReset(void);
+
+#ifdef __cplusplus
+} // extern "C"
+
+// One line per handler that has run (IsrProfile.cpp):
+//   name count avg_cycles max_cycles max_latency_cycles
+void isrProfilePrint(Print &out);
+#endif
+
+#endif // ndef IsrProfile_h
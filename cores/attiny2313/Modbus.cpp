@@ -0,0 +1,333 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+/*
+  Modbus.cpp - Modbus RTU slave on the UART
+
+  Copyright (c) 2011 Applied Platonics.
+
+  This file is a part of the PlatoBoard,
+  http://www.appliedplatonics.com/platoboard/
+
+  Distributed under the terms of the GPL.
+
+  Build with -DMODBUS_SLAVE=1 and give modbusBegin() a table of
+  registers and one of coils, in flash:
+
+    uint16_t setpoint, reading;
+
+    const struct modbus_register regs[] PROGMEM = {
+      MODBUS_REG(setpoint),           // 0
+      MODBUS_REG_RO(reading),         // 1
+    };
+    const struct modbus_coil coils[] PROGMEM = {
+      MODBUS_COIL(PORTB, 0),          // 0: pin 7, as an output
+      MODBUS_COIL_RO(PIND, 2),        // 1: pin 2, as an input
+    };
+
+    void setup()
+    {
+      pinMode(7, OUTPUT);
+      modbusBegin(19200, 17, regs, 2, coils, 2);
+      Serial.driverEnable(3);         // RS-485 DE on pin 3
+    }
+
+  The UART's receive interrupt feeds each byte straight to the frame
+  assembler here, which checks the address and runs the CRC as the
+  bytes come in, and restarts timer 1's compare B.  When that fires,
+  3.5 characters (1.75 ms above 19200 baud) after the last byte, the
+  frame is complete.  modbusPoll(), which main() calls after every
+  loop(), then carries it out and sends the reply; a sketch that
+  spends long inside loop() should call it too, as the master is
+  waiting.  Bytes that come in before a frame has been dealt with are
+  dropped, so the master has to wait for each reply, as it should.
+
+  Functions: read coils (1), read discrete inputs (2, the coil table
+  again), read holding and input registers (3 and 4, both the register
+  table), write single coil (5), write single register (6) and write
+  multiple registers (16).  Others get exception 1.
+
+  The CRC is avr-libc's _crc16_update(), which is the Modbus CRC and
+  takes no table.  The reply is built over the request, so
+  MODBUS_FRAME_SIZE bytes of RAM are all there is: at the default 32 a
+  read can ask for up to 13 registers.
+*/
+
+#include <inttypes.h>
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
+#include "wiring_private.h"
+
+#include "TinySerial.h"
+#include "Modbus.h"
+
+#if MODBUS_SLAVE
+
+#if SERIAL_BUS
+#error "MODBUS_SLAVE and SERIAL_BUS both want the UART receiver"
+#endif
+
+#ifndef MODBUS_FRAME_SIZE
+#define MODBUS_FRAME_SIZE 32
+#endif
+
+#define MODBUS_BROADCAST 0
+
+// exception codes
+#define ILLEGAL_FUNCTION 1
+#define ILLEGAL_DATA_ADDRESS 2
+#define ILLEGAL_DATA_VALUE 3
+
+// modbus_state
+#define MB_RECEIVING 0
+#define MB_SKIPPING 1           // not for us, or broken: wait for the gap
+#define MB_READY 2              // for modbusPoll()
+
+static uint8_t modbus_frame[MODBUS_FRAME_SIZE];
+static volatile uint8_t modbus_len;
+static volatile uint8_t modbus_state;
+static uint16_t modbus_crc;     // 0 at the end of a good frame
+
+static uint8_t modbus_address;
+static const struct modbus_register *modbus_regs;
+static uint8_t modbus_nregs;
+static const struct modbus_coil *modbus_coils;
+static uint8_t modbus_ncoils;
+
+// The gap is gap_laps whole trips of timer 1 and then gap_ticks more
+// (1 to 65536, which is 0); laps_left counts down the trips.
+static uint8_t gap_laps;
+static uint16_t gap_ticks;
+static volatile uint8_t laps_left;
+
+void modbusRxByte(uint8_t c, uint8_t status)
+{
+  // every byte, ours or not, pushes the end of the frame back
+  OCR1B = TCNT1 + gap_ticks;
+  laps_left = gap_laps;
+  TIFR = _BV(OCF1B);
+  TIMSK |= _BV(OCIE1B);
+
+  if (modbus_state != MB_RECEIVING)
+    return;
+
+  if ((status & (_BV(FE) | _BV(UPE) | _BV(DOR)))
+      || modbus_len == MODBUS_FRAME_SIZE
+      || (modbus_len == 0 && c != modbus_address && c != MODBUS_BROADCAST)) {
+    modbus_state = MB_SKIPPING;
+    return;
+  }
+
+  if (modbus_len == 0) modbus_crc = 0xFFFF;
+  modbus_crc = _crc16_update(modbus_crc, c);
+  modbus_frame[modbus_len++] = c;
+}
+
+// The line has been quiet for 3.5 characters.
+ISR(TIMER1_COMPB_vect)
+{
+  ISR_PROFILE_ENTER();
+
+  if (laps_left) {
+    laps_left--;
+  } else {
+    TIMSK &= ~_BV(OCIE1B);
+    if (modbus_state == MB_RECEIVING && modbus_len >= 4)
+      modbus_state = MB_READY;
+    if (modbus_state != MB_READY) {
+      modbus_state = MB_RECEIVING;
+      modbus_len = 0;
+    }
+  }
+
+  ISR_PROFILE_EXIT(ISR_PROF_TIMER1_COMPB);
+}
+
+void modbusBegin(long baud, uint8_t address,
+                 const struct modbus_register *regs, uint8_t nregs,
+                 const struct modbus_coil *coils, uint8_t ncoils)
+{
+  unsigned long ticks;
+
+  modbus_address = address;
+  modbus_regs = regs;
+  modbus_nregs = nregs;
+  modbus_coils = coils;
+  modbus_ncoils = ncoils;
+
+  // 3.5 characters of 11 bits, but no less than 1.75 ms
+  if (baud > 19200)
+    ticks = F_CPU / 4000 * 7;
+  else
+    ticks = F_CPU / baud * 77 / 2;
+  ticks = ticks / TIMER1_PRESCALE - 1;
+  gap_laps = ticks >> 16;
+  gap_ticks = ticks + 1;
+
+  modbus_state = MB_RECEIVING;
+  modbus_len = 0;
+  Serial.begin(baud);
+}
+
+static inline uint16_t get_word(const uint8_t *p)
+{
+  return (p[0] << 8) | p[1];
+}
+
+static inline void put_word(uint8_t *p, uint16_t w)
+{
+  p[0] = w >> 8;
+  p[1] = w & 0xFF;
+}
+
+static uint8_t read_coil(uint8_t i)
+{
+  volatile uint8_t *reg = (volatile uint8_t *) pgm_read_word(&modbus_coils[i].reg);
+
+  return *reg & pgm_read_byte(&modbus_coils[i].mask);
+}
+
+static uint8_t write_coil(uint8_t i, uint8_t on)
+{
+  const struct modbus_coil *coil = &modbus_coils[i];
+  volatile uint8_t *reg;
+  uint8_t mask, oldSREG;
+
+  if (pgm_read_byte(&coil->flags) & MODBUS_READ_ONLY)
+    return ILLEGAL_DATA_ADDRESS;
+
+  reg = (volatile uint8_t *) pgm_read_word(&coil->reg);
+  mask = pgm_read_byte(&coil->mask);
+
+  // a port may be shared with interrupt handlers
+  oldSREG = SREG;
+  cli();
+  if (on) *reg |= mask;
+  else *reg &= ~mask;
+  SREG = oldSREG;
+  return 0;
+}
+
+static inline uint16_t *register_value(uint8_t i)
+{
+  return (uint16_t *) pgm_read_word(&modbus_regs[i].value);
+}
+
+static inline uint8_t register_writable(uint8_t i)
+{
+  return !(pgm_read_byte(&modbus_regs[i].flags) & MODBUS_READ_ONLY);
+}
+
+// Carry out the request in modbus_frame, len bytes with the CRC, and
+// build the reply over it.  Returns the reply's length without its
+// CRC, or an exception code with the top bit set.
+static uint8_t modbus_request(uint8_t len)
+{
+  uint8_t *f = modbus_frame;
+  uint16_t start = get_word(f + 2);
+  uint16_t count = get_word(f + 4);
+  uint8_t i, n;
+
+  switch (f[1]) {
+  case 1:                       // read coils
+  case 2:                       // read discrete inputs
+    if (len != 8 || count == 0 || count > (MODBUS_FRAME_SIZE - 5) * 8)
+      return 0x80 | ILLEGAL_DATA_VALUE;
+    if (start >= modbus_ncoils || count > modbus_ncoils - start)
+      return 0x80 | ILLEGAL_DATA_ADDRESS;
+    n = (count + 7) / 8;
+    f[2] = n;
+    for (i = 0; i < n; i++)
+      f[3 + i] = 0;
+    for (i = 0; i < count; i++)
+      if (read_coil(start + i))
+        f[3 + i / 8] |= _BV(i & 7);
+    return 3 + n;
+
+  case 3:                       // read holding registers
+  case 4:                       // read input registers
+    if (len != 8 || count == 0 || count > (MODBUS_FRAME_SIZE - 5) / 2)
+      return 0x80 | ILLEGAL_DATA_VALUE;
+    if (start >= modbus_nregs || count > modbus_nregs - start)
+      return 0x80 | ILLEGAL_DATA_ADDRESS;
+    f[2] = count * 2;
+    for (i = 0; i < count; i++)
+      put_word(f + 3 + 2 * i, *register_value(start + i));
+    return 3 + count * 2;
+
+  case 5:                       // write single coil, echoed
+    if (len != 8 || (count != 0xFF00 && count != 0x0000))
+      return 0x80 | ILLEGAL_DATA_VALUE;
+    if (start >= modbus_ncoils)
+      return 0x80 | ILLEGAL_DATA_ADDRESS;
+    if (write_coil(start, count != 0))
+      return 0x80 | ILLEGAL_DATA_ADDRESS;
+    return 6;
+
+  case 6:                       // write single register, echoed
+    if (len != 8)
+      return 0x80 | ILLEGAL_DATA_VALUE;
+    if (start >= modbus_nregs || !register_writable(start))
+      return 0x80 | ILLEGAL_DATA_ADDRESS;
+    *register_value(start) = count;
+    return 6;
+
+  case 16:                      // write multiple registers
+    if (count == 0 || count > (MODBUS_FRAME_SIZE - 9) / 2
+        || f[6] != count * 2 || len != 9 + count * 2)
+      return 0x80 | ILLEGAL_DATA_VALUE;
+    if (start >= modbus_nregs || count > modbus_nregs - start)
+      return 0x80 | ILLEGAL_DATA_ADDRESS;
+    // all or nothing
+    for (i = 0; i < count; i++)
+      if (!register_writable(start + i))
+        return 0x80 | ILLEGAL_DATA_ADDRESS;
+    for (i = 0; i < count; i++)
+      *register_value(start + i) = get_word(f + 7 + 2 * i);
+    return 6;
+  }
+
+  return 0x80 | ILLEGAL_FUNCTION;
+}
+
+// Deal with the frame that has come in, if one has.  Returns its
+// function code, or 0 if there was nothing for us.
+uint8_t modbusPoll(void)
+{
+  uint8_t *f = modbus_frame;
+  uint8_t fc, n, i, oldSREG;
+  uint16_t crc;
+
+  if (modbus_state != MB_READY)
+    return 0;
+
+  fc = 0;
+  if (modbus_crc == 0) {
+    fc = f[1];
+    n = modbus_request(modbus_len);
+    if (n & 0x80) {
+      f[1] |= 0x80;
+      f[2] = n & 0x7F;
+      n = 3;
+    }
+
+    // nobody answers a broadcast
+    if (f[0] != MODBUS_BROADCAST) {
+      crc = 0xFFFF;
+      for (i = 0; i < n; i++)
+        crc = _crc16_update(crc, f[i]);
+      Serial.write(f, n);
+      Serial.write(crc & 0xFF);
+      Serial.write(crc >> 8);
+    }
+  }
+
+  // Only now may the next frame come in over this one.  If bytes came
+  // in meanwhile, the rest of their frame is skipped.
+  oldSREG = SREG;
+  cli();
+  modbus_len = 0;
+  modbus_state = (TIMSK & _BV(OCIE1B)) ? MB_SKIPPING : MB_RECEIVING;
+  SREG = oldSREG;
+  return fc;
+}
+
+#endif
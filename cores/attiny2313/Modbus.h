@@ -0,0 +1,57 @@
+/* -*- mode: C; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+/*
+  Modbus.h - Modbus RTU slave on the UART
+
+  Copyright (c) 2011 Applied Platonics.
+
+  This file is a part of the PlatoBoard,
+  http://www.appliedplatonics.com/platoboard/
+
+  Distributed under the terms of the GPL.
+
+  Only there when the core is built with -DMODBUS_SLAVE=1; see
+  Modbus.cpp for how to use it.
+*/
+
+#ifndef Modbus_h
+#define Modbus_h
+
+#include <inttypes.h>
+#include <avr/io.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+  // Entries for the register and coil tables given to modbusBegin().
+  // Table index is Modbus address.  A coil is one bit of any byte in
+  // RAM or the I/O space, so a pin's PORTx bit makes a coil of the
+  // pin itself, and its PINx bit a read-only input.
+#define MODBUS_READ_ONLY 0x01
+#define MODBUS_REG(var) { &(var), 0 }
+#define MODBUS_REG_RO(var) { &(var), MODBUS_READ_ONLY }
+#define MODBUS_COIL(reg, bit) { &(reg), _BV(bit), 0 }
+#define MODBUS_COIL_RO(reg, bit) { &(reg), _BV(bit), MODBUS_READ_ONLY }
+
+  // Modbus register and coil map entries, kept in PROGMEM
+  struct modbus_register {
+    uint16_t *value;
+    uint8_t flags;
+  };
+
+  struct modbus_coil {
+    volatile uint8_t *reg;
+    uint8_t mask;
+    uint8_t flags;
+  };
+
+  void modbusBegin(long baud, uint8_t address,
+                   const struct modbus_register *regs, uint8_t nregs,
+                   const struct modbus_coil *coils, uint8_t ncoils);
+  uint8_t modbusPoll(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // ndef Modbus_h
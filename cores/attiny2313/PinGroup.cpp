@@ -0,0 +1,168 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+/*
+  PinGroup.cpp - Treat a handful of Wiring pins as one parallel bus
+
+  Copyright (c) 2011 Applied Platonics.
+
+  This file is a part of the PlatoBoard, 
+  http://www.appliedplatonics.com/platoboard/
+
+  Distributed under the terms of the GPL.
+*/
+
+#include <inttypes.h>
+#include "wiring_private.h"
+#include "pins_platoboard2313.h"
+#include "wiring_fast.h"
+
+#include "PinGroup.h"
+
+// Constructors ////////////////////////////////////////////////////////////////
+
+PinGroup::PinGroup(uint8_t p0, uint8_t p1, uint8_t p2, uint8_t p3,
+                   uint8_t p4, uint8_t p5, uint8_t p6, uint8_t p7)
+{
+  _count = 0;
+  _onB = 0;
+  _maskB = 0;
+  _maskD = 0;
+  _shift = -1;
+
+  add(p0); add(p1); add(p2); add(p3);
+  add(p4); add(p5); add(p6); add(p7);
+
+  // Can we skip the per-bit shuffle?  Only if everything is on one
+  // port, and the masks are a single run of bits starting at the
+  // first pin, in order.
+  uint8_t mask = _onB ? _maskB : _maskD;
+  if (_count && (_maskB == 0 || _maskD == 0)) {
+    int8_t shift = 0;
+    while (!(_bit[0] & (1 << shift)))
+      shift++;
+
+    uint8_t i;
+    for (i = 0; i < _count; i++)
+      if (_bit[i] != (uint8_t)(1 << (shift + i)))
+        break;
+
+    if (i == _count && mask == (uint8_t)(((1 << _count) - 1) << shift))
+      _shift = shift;
+  }
+}
+
+// Private Methods /////////////////////////////////////////////////////////////
+
+void PinGroup::add(uint8_t pin)
+{
+  if (pin >= NUM_DIGITAL_PINS || _count == PINGROUP_MAX_PINS) return;
+
+  uint16_t desc = digitalPinToDesc(pin);
+  uint8_t bit = pinDescBitMask(desc);
+
+  _bit[_count] = bit;
+  if (pinDescPort(desc) == PB) {
+    _onB |= 1 << _count;
+    _maskB |= bit;
+  } else {
+    _maskD |= bit;
+  }
+  _count++;
+}
+
+// Turn a group value into the bits to drive on each port.
+void PinGroup::spread(uint8_t value, uint8_t *b, uint8_t *d)
+{
+  uint8_t i, pb = 0, pd = 0;
+
+  if (_shift >= 0) {
+    if (_maskB) pb = (value << _shift) & _maskB;
+    else pd = (value << _shift) & _maskD;
+  } else {
+    for (i = 0; i < _count; i++, value >>= 1) {
+      if (!(value & 1)) continue;
+      if (_onB & (1 << i)) pb |= _bit[i];
+      else pd |= _bit[i];
+    }
+  }
+
+  *b = pb;
+  *d = pd;
+}
+
+// Public Methods //////////////////////////////////////////////////////////////
+
+void PinGroup::output(void)
+{
+  if (_maskB) portModeMask(PB, _maskB, OUTPUT);
+  if (_maskD) portModeMask(PD, _maskD, OUTPUT);
+}
+
+void PinGroup::input(void)
+{
+  if (_maskB) portModeMask(PB, _maskB, INPUT);
+  if (_maskD) portModeMask(PD, _maskD, INPUT);
+}
+
+void PinGroup::write(uint8_t value)
+{
+  uint8_t b, d;
+  spread(value, &b, &d);
+
+  // Both ports inside the one critical section, so the two halves
+  // of a split bus change back to back.
+  uint8_t oldSREG = SREG;
+  cli();
+  if (_maskB) PORTB = (PORTB & ~_maskB) | b;
+  if (_maskD) PORTD = (PORTD & ~_maskD) | d;
+  SREG = oldSREG;
+}
+
+uint8_t PinGroup::read(void)
+{
+  uint8_t pb = PINB, pd = PIND;
+  uint8_t i, value = 0;
+
+  if (_shift >= 0)
+    return ((_maskB ? pb & _maskB : pd & _maskD) >> _shift);
+
+  for (i = _count; i-- > 0; ) {
+    value <<= 1;
+    if ((_onB & (1 << i)) ? (pb & _bit[i]) : (pd & _bit[i]))
+      value |= 1;
+  }
+
+  return value;
+}
+
+void PinGroup::set(uint8_t bits)
+{
+  uint8_t b, d;
+  spread(bits, &b, &d);
+
+  uint8_t oldSREG = SREG;
+  cli();
+  PORTB |= b;
+  PORTD |= d;
+  SREG = oldSREG;
+}
+
+void PinGroup::clear(uint8_t bits)
+{
+  uint8_t b, d;
+  spread(bits, &b, &d);
+
+  uint8_t oldSREG = SREG;
+  cli();
+  PORTB &= ~b;
+  PORTD &= ~d;
+  SREG = oldSREG;
+}
+
+void PinGroup::toggle(uint8_t bits)
+{
+  uint8_t b, d;
+  spread(bits, &b, &d);
+
+  PINB = b;
+  PIND = d;
+}
@@ -0,0 +1,59 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+/*
+  PinGroup.h - Treat a handful of Wiring pins as one parallel bus
+
+  Copyright (c) 2011 Applied Platonics.
+
+  This file is a part of the PlatoBoard, 
+  http://www.appliedplatonics.com/platoboard/
+
+  Distributed under the terms of the GPL.
+*/
+
+#ifndef PinGroup_h
+#define PinGroup_h
+
+#include <inttypes.h>
+
+#define PINGROUP_MAX_PINS 8
+#define PINGROUP_NO_PIN 255
+
+// A PinGroup maps bit i of a value onto the i'th pin it was built
+// from, e.g.
+//
+//   PinGroup dac(7, 8, 9, 10, 11, 12, 13, 14);  // PB0..PB7
+//   dac.output();
+//   dac.write(0x80);
+//
+// Each operation does one register write per port involved (at most
+// two on the 2313, PORTB and PORTD), so all the pins on a port change
+// on the same clock.  If the pins are consecutive bits of a single
+// port in order, as above, the bit shuffling is skipped entirely.
+class PinGroup
+{
+public:
+  PinGroup(uint8_t p0,
+           uint8_t p1 = PINGROUP_NO_PIN, uint8_t p2 = PINGROUP_NO_PIN,
+           uint8_t p3 = PINGROUP_NO_PIN, uint8_t p4 = PINGROUP_NO_PIN,
+           uint8_t p5 = PINGROUP_NO_PIN, uint8_t p6 = PINGROUP_NO_PIN,
+           uint8_t p7 = PINGROUP_NO_PIN);
+  void output(void);
+  void input(void);
+  void write(uint8_t);
+  uint8_t read(void);
+  void set(uint8_t);
+  void clear(uint8_t);
+  void toggle(uint8_t);
+private:
+  void add(uint8_t);
+  void spread(uint8_t, uint8_t *, uint8_t *);
+
+  uint8_t _count;
+  uint8_t _onB;     // bit i set if pin i is on port B
+  uint8_t _maskB;   // all port B bits in the group
+  uint8_t _maskD;   // all port D bits in the group
+  int8_t _shift;    // >= 0: group is _count consecutive bits from here
+  uint8_t _bit[PINGROUP_MAX_PINS];
+};
+
+#endif // ndef PinGroup_h
@@ -0,0 +1,99 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+/*
+  SlipFrame.h - Binary frames over a Print or Stream, with a CRC
+
+  Copyright (c) 2011 Applied Platonics.
+
+  This file is a part of the PlatoBoard,
+  http://www.appliedplatonics.com/platoboard/
+
+  Distributed under the terms of the GPL.
+*/
+
+#ifndef SlipFrame_h
+#define SlipFrame_h
+
+#include <inttypes.h>
+#include "Stream.h"
+
+// RFC 1055 SLIP framing.  A frame is
+//
+//   END payload crc_hi crc_lo END
+//
+// with END (0xC0) and ESC (0xDB) inside escaped as ESC ESC_END and
+// ESC ESC_ESC.  The CRC is CRC-16/CCITT (polynomial 0x1021, starting
+// at 0xFFFF, not reflected) of the payload, so on a host it is
+// binascii.crc_hqx(payload, 0xFFFF).  A 16-bit reading costs 2 to 4
+// bytes on the wire, against up to 6 plus a separator as text.
+#define SLIP_END 0xC0
+#define SLIP_ESC 0xDB
+#define SLIP_ESC_END 0xDC
+#define SLIP_ESC_ESC 0xDD
+
+// -DSLIP_CRC_TABLE=1 works the CRC out from a 512-byte table in flash
+// rather than with avr-libc's _crc_xmodem_update().  That is a
+// quarter of the 2313's flash; the SlipWriter rows of bench/ show
+// what, if anything, it saves.
+#ifndef SLIP_CRC_TABLE
+#define SLIP_CRC_TABLE 0
+#endif
+
+uint16_t slipCrcUpdate(uint16_t crc, uint8_t c);
+
+// Writes frames to any Print, such as Serial, a byte at a time as they
+// are built; nothing is buffered here.
+//
+//   SlipWriter slip(Serial);
+//
+//   slip.begin();
+//   slip.write16(analogRead(0));
+//   slip.write32(millis());
+//   slip.end();
+//
+// Between begin() and end(), everything Print does goes into the
+// payload, print() included.
+class SlipWriter : public Print
+{
+public:
+  SlipWriter(Print &out) : _out(out) {}
+  void begin(void);
+  void end(void);
+  virtual void write(uint8_t);
+  void write16(uint16_t);       // low byte first
+  void write32(uint32_t);       // low byte first
+  using Print::write; // pull in write(str) and write(buf, size) from Print
+private:
+  Print &_out;
+  uint16_t _crc;
+};
+
+// Reassembles frames from a Stream into a buffer the caller owns.
+//
+//   uint8_t buf[16];
+//   SlipReader slip(Serial, buf, sizeof(buf));
+//
+//   int n = slip.poll();
+//   if (n >= 0)
+//     ...                      // buf holds an n-byte payload
+//
+// poll() takes what the Stream has and returns as soon as a frame is
+// complete, so it never waits.  Frames that are too long for the
+// buffer or fail the CRC are dropped and counted.
+class SlipReader
+{
+public:
+  SlipReader(Stream &in, uint8_t *buf, uint8_t size);
+  int poll(void);
+  uint8_t errors(void) { return _errors; }
+  void clearErrors(void) { _errors = 0; }
+private:
+  Stream &_in;
+  uint8_t *_buf;
+  uint8_t _size;
+  uint8_t _len;                 // bytes so far, the CRC included
+  uint8_t _state;
+  uint8_t _errors;
+  uint16_t _crc;
+};
+
+#endif // ndef SlipFrame_h
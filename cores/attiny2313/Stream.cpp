@@ -0,0 +1,147 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+/*
+  Stream.cpp - Timed and parsing reads for any Stream
+
+  Copyright (c) 2011 Applied Platonics.
+
+  This file is a part of the PlatoBoard,
+  http://www.appliedplatonics.com/platoboard/
+
+  Distributed under the terms of the GPL.
+
+  The timeouts run off the low 16 bits of millis(), which is why
+  setTimeout() stops at 65535 ms.
+*/
+
+#include <inttypes.h>
+#include <string.h>
+#include "wiring.h"
+
+#include "Stream.h"
+
+// Protected Methods ///////////////////////////////////////////////////////////
+
+int Stream::timedRead(void)
+{
+  unsigned int start = millis();
+  int c;
+
+  do {
+    c = read();
+    if (c >= 0) return c;
+  } while ((unsigned int) millis() - start < _timeout);
+  return -1;
+}
+
+int Stream::timedPeek(void)
+{
+  unsigned int start = millis();
+  int c;
+
+  do {
+    c = peek();
+    if (c >= 0) return c;
+  } while ((unsigned int) millis() - start < _timeout);
+  return -1;
+}
+
+// Throw away everything up to the next digit or '-', and return it
+// without reading it; -1 on a timeout.
+int Stream::peekDigit(void)
+{
+  int c;
+
+  while ((c = timedPeek()) >= 0) {
+    if (c == '-' || (c >= '0' && c <= '9'))
+      return c;
+    read();
+  }
+  return -1;
+}
+
+// The longest k < m for which the first k bytes of s are also the
+// last k of its first m.
+static uint8_t overlap(const char *s, uint8_t m)
+{
+  uint8_t k;
+
+  for (k = m - 1; k > 0; k--)
+    if (!strncmp(s, s + m - k, k)) break;
+  return k;
+}
+
+// Public Methods //////////////////////////////////////////////////////////////
+
+// Whatever has come in is taken a buffer at a time, and the clock only
+// restarts when a read comes back empty.
+size_t Stream::readBytes(char *buf, size_t len)
+{
+  size_t n = 0, got;
+  unsigned int start = millis();
+
+  while (n < len) {
+    got = readAvailable((uint8_t *) buf + n, len - n);
+    if (got) {
+      n += got;
+      start = millis();
+    } else if ((unsigned int) millis() - start >= _timeout) {
+      break;
+    }
+  }
+  return n;
+}
+
+size_t Stream::readBytesUntil(char terminator, char *buf, size_t len)
+{
+  size_t n = 0;
+  int c;
+
+  while (n < len) {
+    c = timedRead();
+    if (c < 0 || c == terminator) break;
+    buf[n++] = c;
+  }
+  return n;
+}
+
+// On a mismatch part of what was matched may still start target, as
+// "aab" starts in "aaab", so fall back to the longest start of target
+// that the bytes matched so far end with.
+bool Stream::find(const char *target)
+{
+  uint8_t m = 0;                // bytes of target matched
+  int c;
+
+  if (!*target) return true;
+
+  while ((c = timedRead()) >= 0) {
+    while (m && c != target[m])
+      m = overlap(target, m);
+    if (c == target[m]) m++;
+    if (!target[m]) return true;
+  }
+  return false;
+}
+
+long Stream::parseInt(void)
+{
+  long value = 0;
+  bool negative = false;
+  int c;
+
+  c = peekDigit();
+  if (c < 0) return 0;
+  if (c == '-') {
+    negative = true;
+    read();
+  }
+
+  // the number ends at the first non-digit, which is left unread, or
+  // when nothing more comes
+  while ((c = timedPeek()) >= '0' && c <= '9') {
+    value = value * 10 + c - '0';
+    read();
+  }
+
+  return negative ? -value : value;
+}
@@ -3,6 +3,8 @@
    Stream.h - base class for character-based streams.
    Copyright (c) 2010 David A. Mellis.  All right reserved.
 
+   Portions copyright (c) 2011 Applied Platonics.
+
    This library is free software; you can redistribute it and/or
    modify it under the terms of the GNU Lesser General Public
    License as published by the Free Software Foundation; either
@@ -24,13 +26,49 @@
 #include <inttypes.h>
 #include "Print.h"
 
+// The readers below wait up to setTimeout() ms (1000 to start with)
+// for each byte, and return what they have when it runs out.  None of
+// them touch the heap.  They live in Stream.cpp, which is only linked
+// into sketches that call one of them.
 class Stream : public Print
 {
 public:
+  Stream() : _timeout(1000) {}
   virtual int available() = 0;
   virtual int read() = 0;
   virtual int peek() = 0;
   virtual void flush() = 0;
+
+  // Up to n bytes that have already come in, without waiting.  A
+  // stream with a buffer can hand them over in one go.
+  virtual size_t readAvailable(uint8_t *buf, size_t n)
+  {
+    size_t i;
+    int c;
+
+    for (i = 0; i < n && (c = read()) >= 0; i++)
+      buf[i] = c;
+    return i;
+  }
+
+  void setTimeout(unsigned int ms) { _timeout = ms; }
+
+  // len bytes into buf, or fewer on a timeout; returns how many.
+  size_t readBytes(char *buf, size_t len);
+  // Bytes into buf up to terminator, which is read but not stored, or
+  // len bytes, or a timeout; returns how many were stored.
+  size_t readBytesUntil(char terminator, char *buf, size_t len);
+  // Read until target has gone past: true, or false on a timeout.
+  bool find(const char *target);
+  // Skip anything before a number, then read it; 0 on a timeout.
+  long parseInt(void);
+
+protected:
+  int timedRead(void);
+  int timedPeek(void);
+  int peekDigit(void);
+
+  unsigned int _timeout;        // ms
 };
 
 #endif
@@ -25,38 +25,173 @@
 
 #include <avr/pgmspace.h>
 #include "TinySerial.h"
+#include "RingBuffer.h"
+
+// Bytes received and not yet read.  A power of two, at most 128.
+#ifndef SERIAL_RX_BUFFER_SIZE
+#define SERIAL_RX_BUFFER_SIZE 16
+#endif
+
+// Bytes written are queued here and sent from the data register empty
+// interrupt, so write() only waits when the queue is full.  A power of
+// two, at most 128 (RingBuffer checks); 0 drops the queue and write()
+// waits for the UART as it used to.
+#ifndef SERIAL_TX_BUFFER_SIZE
+#define SERIAL_TX_BUFFER_SIZE 16
+#endif
+
+// The handler puts, the sketch gets; neither needs cli().  A byte
+// that arrives with the buffer full is dropped.
+static RingBuffer<SERIAL_RX_BUFFER_SIZE> rx_buffer;
+
+// What went wrong on the receive side, for dropped() and friends.
+// Single bytes, so the sketch can read them without cli(); each
+// sticks at 255 rather than wrap.
+static volatile uint8_t rx_dropped;
+static volatile uint8_t rx_overruns;
+static volatile uint8_t rx_frame_errors;
+static volatile uint8_t rx_parity_errors;
+
+static inline void count_error(volatile uint8_t &count)
+{
+  uint8_t n = count + 1;
+  if (n) count = n;
+}
 
-#define RX_BUFFER_SIZE 16
+#if SERIAL_BUS
+static uint8_t bus_address;
 
-struct ring_buffer
-{
-  unsigned char buffer[RX_BUFFER_SIZE];
-  int head;
-  int tail;
-};
+// address frames for us, counted by the handler; newFrame() keeps up
+// with it through bus_frames_seen
+static volatile uint8_t bus_frames;
+static uint8_t bus_frames_seen;
+#endif
 
-static ring_buffer _rx_buffer  =  { { 0 }, 0, 0 };
-static ring_buffer *rx_buffer = &_rx_buffer;
+#if SERIAL_DRIVER_ENABLE
+static volatile uint8_t *bus_de_port;
+static uint8_t bus_de_mask;     // 0 without a DE pin
+
+// Take the bus before loading the transmitter.  Interrupts off.
+static inline void bus_drive(void)
+{
+  if (bus_de_mask) *bus_de_port |= bus_de_mask;
+}
 
-inline void store_char(unsigned char c)
+static inline void bus_release(void)
 {
-  int i = (unsigned int)(rx_buffer->head + 1) % RX_BUFFER_SIZE;
+  if (bus_de_mask) *bus_de_port &= ~bus_de_mask;
+}
+#else
+static inline void bus_drive(void) {}
+#endif
 
-  // if we should be storing the received character into the location
-  // just before the tail (meaning that the head would advance to the
-  // current location of the tail), we're about to overflow the buffer
-  // and so we don't write the character or advance the head.
-  if (i != rx_buffer->tail) {
-    rx_buffer->buffer[rx_buffer->head] = c;
-    rx_buffer->head = i;
+ISR(USART_RX_vect)
+{
+  ISR_PROFILE_ENTER();
+
+  // The error flags describe the byte in RXB, so they have to be read
+  // before it is.  DOR means the UART lost bytes before this one
+  // because we didn't get here in time; a byte with a parity error is
+  // thrown away.
+  uint8_t status = UCSRA;
+#if SERIAL_BUS
+  uint8_t ucsrb = UCSRB;
+#endif
+  uint8_t c = RXB;
+
+  if (status & (_BV(FE) | _BV(DOR))) {
+    if (status & _BV(DOR)) count_error(rx_overruns);
+    if (status & _BV(FE)) count_error(rx_frame_errors);
   }
+
+#if MODBUS_SLAVE
+  // the frame assembler has the receiver to itself
+  modbusRxByte(c, status);
+#else
+#if SERIAL_BUS
+  // An address frame: listen to the data frames that follow if it's
+  // ours, otherwise leave them to the UART to drop.  Only address
+  // frames get here while MPCM is set.
+  if ((ucsrb & _BV(UCSZ2)) && (ucsrb & _BV(RXB8))) {
+    if (!(status & (_BV(FE) | _BV(UPE)))
+        && (c == bus_address || c == SERIAL_BUS_BROADCAST)) {
+      cbi(UCSRA, MPCM);
+      bus_frames++;
+    } else
+      sbi(UCSRA, MPCM);
+  } else
+#endif
+  if (status & _BV(UPE))
+    count_error(rx_parity_errors);
+  else if (!rx_buffer.put(c))
+    count_error(rx_dropped);
+#endif
+
+  ISR_PROFILE_EXIT(ISR_PROF_USART_RX);
 }
 
+// set once anything has been sent, so flush() knows TXC will come;
+// cleared again by the bus driver's transmit complete handler
+static volatile uint8_t tx_written;
 
-ISR(USART_RX_vect)
+// Load the data register, clearing TXC so that flush() can tell when
+// this byte has gone.  TXC clears by writing a one; the other flags
+// in UCSRA must be written as zero.
+static inline void tx_put(uint8_t c)
+{
+  UCSRA = (UCSRA & (_BV(U2X) | _BV(MPCM))) | _BV(TXC);
+  TXB = c;
+}
+
+#if SERIAL_TX_BUFFER_SIZE
+// The sketch puts, the handler gets.
+static RingBuffer<SERIAL_TX_BUFFER_SIZE> tx_buffer;
+
+// Send the next queued byte, and stop the interrupt once the queue is
+// empty.  Called with interrupts off.
+static inline void tx_udr_empty(void)
+{
+  int c = tx_buffer.get();
+
+  if (c >= 0)
+    tx_put(c);
+  if (tx_buffer.empty())
+    cbi(UCSRB, UDRIE);
+}
+
+ISR(USART_UDRE_vect)
+{
+  ISR_PROFILE_ENTER();
+  tx_udr_empty();
+  ISR_PROFILE_EXIT(ISR_PROF_USART_UDRE);
+}
+#endif
+
+#if SERIAL_DRIVER_ENABLE
+// Only enabled with a DE pin.  TXC also comes when the handler above
+// was late refilling the data register, so let the bus go only when
+// nothing is waiting to be sent.  Taking this interrupt clears TXC,
+// which is why flush() also looks at tx_written.
+ISR(USART_TX_vect)
+{
+  ISR_PROFILE_ENTER();
+
+  if ((UCSRA & _BV(UDRE)) && !(UCSRB & _BV(UDRIE))) {
+    bus_release();
+    tx_written = 0;
+  }
+
+  ISR_PROFILE_EXIT(ISR_PROF_USART_TX);
+}
+#endif
+
+// Whether the last byte written has gone, stop bit and all.
+static inline uint8_t tx_complete(void)
 {
-  unsigned char c = RXB;
-  store_char(c);
+#if SERIAL_DRIVER_ENABLE
+  if (!tx_written) return 1;
+#endif
+  return UCSRA & _BV(TXC);
 }
 
 // Constructors ////////////////////////////////////////////////////////////////
@@ -68,9 +203,21 @@ TinySerial::TinySerial()
 
 // Public Methods //////////////////////////////////////////////////////////////
 
-void TinySerial::beginFromTable(uint16_t ubrr)
+void TinySerial::beginFromTable(uint16_t ubrr, uint8_t u2x)
 {
-  sbi(UCSRA, U2X);
+  tx_written = 0;
+  clearErrors();
+#if SERIAL_DRIVER_ENABLE
+  bus_de_mask = 0;
+#endif
+#if SERIAL_BUS
+  // plain 8-bit frames until beginBus()
+  cbi(UCSRB, UCSZ2);
+  cbi(UCSRA, MPCM);
+#endif
+
+  if (u2x) sbi(UCSRA, U2X);
+  else cbi(UCSRA, U2X);
   UBRRH = 0xff & (ubrr >> 8);
   UBRRL = 0xff & ubrr;
 
@@ -83,63 +230,274 @@ void TinySerial::beginFromTable(uint16_t ubrr)
   UCSRC = (1 << UCSZ1) | (1 << UCSZ0);
 }
 
+// UBRR rounded to the nearest divisor rather than truncated, which
+// keeps the error down at crystal clocks that don't divide evenly.
 void TinySerial::begin(long baud)
 {
-  return beginFromTable( F_CPU/8/baud - 1 );
+  return beginFromTable( (F_CPU/4/baud - 1) / 2 );
 }
 
 void TinySerial::end()
 {
+  // let what's queued go out first
+  flush();
+
   cbi(UCSRB, RXEN);
   cbi(UCSRB, TXEN);
   cbi(UCSRB, RXCIE);
+#if SERIAL_DRIVER_ENABLE
+  // flush() may have seen TXC before its handler could run
+  cbi(UCSRB, TXCIE);
+  bus_release();
+#endif
 }
 
 int TinySerial::available(void)
 {
-  return (unsigned int)(RX_BUFFER_SIZE + rx_buffer->head - rx_buffer->tail) % RX_BUFFER_SIZE;
+  return rx_buffer.count();
 }
 
 int TinySerial::peek(void)
 {
-  if (rx_buffer->head == rx_buffer->tail) {
-    return -1;
-  } else {
-    return rx_buffer->buffer[rx_buffer->tail];
-  }
+  return rx_buffer.peek();
 }
 
 int TinySerial::read(void)
 {
-  // if the head isn't ahead of the tail, we don't have any characters
-  if (rx_buffer->head == rx_buffer->tail)  return -1;
+  return rx_buffer.get();
+}
+
+// straight out of the buffer, with no call per byte
+size_t TinySerial::readAvailable(uint8_t *buf, size_t n)
+{
+  return rx_buffer.get(buf, n > 255 ? 255 : n);
+}
+
+uint8_t TinySerial::dropped(void)
+{
+  return rx_dropped;
+}
+
+uint8_t TinySerial::overruns(void)
+{
+  return rx_overruns;
+}
+
+uint8_t TinySerial::frameErrors(void)
+{
+  return rx_frame_errors;
+}
+
+uint8_t TinySerial::parityErrors(void)
+{
+  return rx_parity_errors;
+}
 
-  unsigned char c = rx_buffer->buffer[rx_buffer->tail];
-  rx_buffer->tail = (unsigned int)(rx_buffer->tail + 1) % RX_BUFFER_SIZE;
-  return c;
+void TinySerial::clearErrors(void)
+{
+  rx_dropped = 0;
+  rx_overruns = 0;
+  rx_frame_errors = 0;
+  rx_parity_errors = 0;
 }
 
+// Wait until everything written has left the transmitter, stop bit
+// and all.  (This used to throw away unread input instead.)
 void TinySerial::flush()
 {
-  // don't reverse this or there may be problems if the RX interrupt
-  // occurs after reading the value of rx_buffer_head but before writing
-  // the value to rx_buffer_tail; the previous value of rx_buffer_head
-  // may be written to rx_buffer_tail, making it appear as if the buffer
-  // don't reverse this or there may be problems if the RX interrupt
-  // occurs after reading the value of rx_buffer_head but before writing
-  // the value to rx_buffer_tail; the previous value of rx_buffer_head
-  // may be written to rx_buffer_tail, making it appear as if the buffer
-  // were full, not empty.
-  rx_buffer->head = rx_buffer->tail;
+  // TXC is never set if nothing has been sent
+  if (!tx_written)
+    return;
+
+#if SERIAL_TX_BUFFER_SIZE
+  while ((UCSRB & _BV(UDRIE)) || !tx_complete()) {
+    // with interrupts off the queue has to be drained from here
+    if (!(SREG & _BV(SREG_I)) && (UCSRB & _BV(UDRIE))
+        && (UCSRA & _BV(UDRE)))
+      tx_udr_empty();
+  }
+#else
+  while (!tx_complete())
+    ;
+#endif
+}
+
+#if SERIAL_TX_BUFFER_SIZE
+void TinySerial::write(uint8_t c)
+{
+  uint8_t oldSREG = SREG;
+
+  // With nothing queued and the data register free, the queue and the
+  // interrupt would only slow things down.  Interrupts are held off so
+  // that a handler that writes too can't slip in between.
+  cli();
+  if (tx_buffer.empty() && (UCSRA & _BV(UDRE))) {
+    bus_drive();
+    tx_put(c);
+    tx_written = 1;
+    SREG = oldSREG;
+    return;
+  }
+  SREG = oldSREG;
+
+  // Queue full: wait for the interrupt to make room, or make room
+  // ourselves if interrupts are off and it never will.
+  while (!tx_buffer.put(c)) {
+    if (!(SREG & _BV(SREG_I)) && (UCSRA & _BV(UDRE)))
+      tx_udr_empty();
+  }
+
+  // The handler, still running from earlier writes, may have sent c
+  // already and stopped; then there's nothing left to start.
+  // Otherwise the bus is taken again in case the transmit complete
+  // handler let it go while the queue was empty.
+  cli();
+  if (!tx_buffer.empty()) {
+    bus_drive();
+    tx_written = 1;
+    sbi(UCSRB, UDRIE);
+  }
+  SREG = oldSREG;
 }
 
+int TinySerial::availableForWrite(void)
+{
+  return tx_buffer.space();
+}
+#else
 void TinySerial::write(uint8_t c)
 {
+  uint8_t oldSREG = SREG;
+
   while (!(UCSRA & (1<<UDRE)))
     ;
 
-  TXB = c;
+  cli();
+  bus_drive();
+  tx_put(c);
+  tx_written = 1;
+  SREG = oldSREG;
+}
+
+int TinySerial::availableForWrite(void)
+{
+  return (UCSRA & _BV(UDRE)) ? 1 : 0;
+}
+#endif
+
+#if SERIAL_DRIVER_ENABLE
+void TinySerial::driverEnable(uint8_t de_pin)
+{
+  uint8_t oldSREG = SREG;
+  uint16_t desc;
+
+  if (de_pin == NOT_A_PIN || de_pin >= NUM_DIGITAL_PINS)
+    return;
+
+  flush();
+  desc = digitalPinToDesc(de_pin);
+
+  cli();
+  bus_de_port = portOutputRegister(pinDescPort(desc));
+  bus_de_mask = pinDescBitMask(desc);
+  bus_release();
+  *portModeRegister(pinDescPort(desc)) |= bus_de_mask;
+  sbi(UCSRB, TXCIE);
+  SREG = oldSREG;
+}
+#endif
+
+#if SERIAL_BUS
+void TinySerial::beginBus(uint8_t address, uint8_t de_pin)
+{
+  uint8_t oldSREG = SREG;
+
+  driverEnable(de_pin);
+  flush();
+  bus_address = address;
+
+  cli();
+  sbi(UCSRB, UCSZ2);
+  sbi(UCSRA, MPCM);
+  SREG = oldSREG;
+}
+
+// Start a message to address: everything written from here on goes to
+// that board, until the next sendTo().  TXB8 goes with whatever byte
+// the transmitter takes next, so this waits for what's already queued
+// to be taken first, and for the address to be taken after.
+void TinySerial::sendTo(uint8_t address)
+{
+  uint8_t oldSREG;
+
+#if SERIAL_TX_BUFFER_SIZE
+  while (UCSRB & _BV(UDRIE)) {
+    if (!(SREG & _BV(SREG_I)) && (UCSRA & _BV(UDRE)))
+      tx_udr_empty();
+  }
+#endif
+  while (!(UCSRA & _BV(UDRE)))
+    ;
+
+  oldSREG = SREG;
+  cli();
+  bus_drive();
+  sbi(UCSRB, TXB8);
+  tx_put(address);
+  tx_written = 1;
+  SREG = oldSREG;
+
+  while (!(UCSRA & _BV(UDRE)))
+    ;
+  cbi(UCSRB, TXB8);
+}
+
+void TinySerial::sendTo(uint8_t address, const uint8_t *buf, uint8_t len)
+{
+  sendTo(address);
+  write(buf, len);
+}
+
+bool TinySerial::newFrame(void)
+{
+  uint8_t n = bus_frames;
+
+  if (n == bus_frames_seen)
+    return false;
+  bus_frames_seen = n;
+  return true;
+}
+
+int TinySerial::request(uint8_t address, const uint8_t *buf, uint8_t len,
+                        uint8_t *reply, uint8_t size, unsigned int timeout_ms)
+{
+  unsigned long start;
+  uint8_t n = 0;
+  int c;
+
+  // nothing that came before is the reply
+  while (read() >= 0)
+    ;
+  newFrame();
+
+  sendTo(address, buf, len);
+  flush();
+  start = millis();
+
+  while (!newFrame())
+    if (millis() - start >= timeout_ms)
+      return -1;
+
+  while (n < size) {
+    c = read();
+    if (c >= 0)
+      reply[n++] = c;
+    else if (millis() - start >= timeout_ms)
+      break;
+  }
+  return n;
 }
+#endif
 
 // Preinstantiate Objects //////////////////////////////////////////////////////
 
@@ -17,23 +17,136 @@
 #include "Stream.h"
 
 #include <avr/io.h>
+#include "wiring.h"
+#include "pins_platoboard2313.h"
 
 #ifndef _AVR_IOTN2313_H_
 #error "TinySerial.h: Not compiling for the ATTiny2313, or screwed-up includes."
 #endif
 
+// begin<RATE>() refuses to build if the nearest rate the UART can make
+// is further off than this, in tenths of a percent.  Past about 2% the
+// receiver starts sampling the wrong bits.
+#ifndef SERIAL_BAUD_ERROR_MAX
+#define SERIAL_BAUD_ERROR_MAX 20
+#endif
+
+// Build with -DSERIAL_BUS=1 for beginBus(), sendTo() and request(),
+// which put a dozen or so boards on one RS-485 pair using the UART's
+// multi-processor mode: 9-bit frames, with the 9th bit set on address
+// frames.  A board listens to data frames only after an address frame
+// with its own address (or SERIAL_BUS_BROADCAST) and the UART drops
+// everything else itself, without interrupting.
+#ifndef SERIAL_BUS
+#define SERIAL_BUS 0
+#endif
+
+#define SERIAL_BUS_BROADCAST 0xFF
+
+// driverEnable() comes with the bus and with Modbus, the two users of
+// RS-485.
+#define SERIAL_DRIVER_ENABLE (SERIAL_BUS || MODBUS_SLAVE)
+
+// UBRR for RATE baud with U2X off (U2X_ON 0, 16 samples a bit) or on (8
+// samples), rounded to the nearest; whether it fits UBRR's 12 bits;
+// and how far off the rate it gives is, in tenths of a percent.
+// Everything here is a compile-time constant.
+template <unsigned long RATE, uint8_t U2X_ON>
+struct TinySerialBaud
+{
+  static const unsigned long div = U2X_ON ? 8 : 16;
+  static const unsigned long twice = 2UL * F_CPU / div / RATE;
+  static const bool fits = twice >= 1 && (twice - 1) / 2 <= 4095;
+  static const uint16_t ubrr = fits ? (twice - 1) / 2 : 0;
+  static const unsigned long actual = F_CPU / div / (ubrr + 1UL);
+  static const unsigned long error = !fits ? 0xFFFFUL :
+    (actual > RATE ? actual - RATE : RATE - actual) * 1000UL / RATE;
+};
+
 class TinySerial : public Stream
 {
 public:
   TinySerial();
-  void beginFromTable(uint16_t);
+  void beginFromTable(uint16_t, uint8_t u2x = 1);
   void begin(long);
+
+  // begin() with the divisor worked out by the compiler, so no
+  // division is linked in, and U2X only used when it gets closer:
+  //
+  //   Serial.begin<9600>();
+  //
+  // A rate the UART can't make within SERIAL_BAUD_ERROR_MAX fails to
+  // compile, with "baud_rate_error_too_large" in the message.
+  template <unsigned long RATE> void begin(void)
+  {
+    typedef TinySerialBaud<RATE, 0> normal;
+    typedef TinySerialBaud<RATE, 1> doubled;
+    static const bool use_normal = normal::error <= doubled::error;
+    static const unsigned long error =
+      use_normal ? normal::error : doubled::error;
+    typedef char baud_rate_error_too_large[error <= SERIAL_BAUD_ERROR_MAX ? 1 : -1];
+
+    beginFromTable(use_normal ? normal::ubrr : doubled::ubrr, !use_normal);
+  }
   void end();
   virtual int available(void);
   virtual int peek(void);
   virtual int read(void);
+  virtual size_t readAvailable(uint8_t *, size_t);
   virtual void flush(void);
   virtual void write(uint8_t);
+  int availableForWrite(void);
+#if SERIAL_DRIVER_ENABLE
+  // Call after begin().  de_pin drives an RS-485 transceiver's DE (and
+  // /RE, tied to it, so we don't hear ourselves): it goes high while
+  // we send and low again from the transmit complete interrupt, so
+  // the bus is let go one stop bit after the last byte.
+  void driverEnable(uint8_t de_pin);
+#endif
+#if SERIAL_BUS
+  // Call after begin(); de_pin is as for driverEnable().
+  //
+  //   Serial.begin(57600);
+  //   Serial.beginBus(5, 2);          // address 5, DE on pin 2
+  //   ...
+  //   Serial.sendTo(0);               // reply to the master at 0
+  //   Serial.write(reading);
+  //
+  // A master is just a board with an address of its own that the
+  // others reply to.  Where one message ends is up to the sketch,
+  // e.g. a fixed length or SlipWriter frames.
+  void beginBus(uint8_t address, uint8_t de_pin = NOT_A_PIN);
+  void sendTo(uint8_t address);
+  void sendTo(uint8_t address, const uint8_t *buf, uint8_t len);
+
+  // True once for each address frame for us (or broadcast) since the
+  // last call: a new message has started.  Its bytes come after any
+  // of the last one that are still unread.
+  bool newFrame(void);
+
+  // For the master: send buf to address and wait for the reply, up
+  // to size bytes, which must start within timeout_ms.
+  //
+  //   uint8_t cmd = READ_TEMP, reply[2];
+  //   if (Serial.request(5, &cmd, 1, reply, 2, 20) == 2)
+  //     ...
+  //
+  // Returns the bytes of reply filled in, which is fewer than size
+  // only if timeout_ms ran out first, or -1 if no reply started.
+  // Unread input is thrown away first.
+  int request(uint8_t address, const uint8_t *buf, uint8_t len,
+              uint8_t *reply, uint8_t size, unsigned int timeout_ms);
+#endif
+
+  // Receive trouble since begin() or clearErrors(), each counted up
+  // to 255: bytes lost for want of buffer space (dropped()) or
+  // because the receive interrupt was held off too long (overruns()),
+  // and bytes that came in garbled (frameErrors(), parityErrors()).
+  uint8_t dropped(void);
+  uint8_t overruns(void);
+  uint8_t frameErrors(void);
+  uint8_t parityErrors(void);
+  void clearErrors(void);
   using Print::write; // pull in write(str) and write(buf, size) from Print
   using Print::writePgm; // pull in write(str) and write(buf, size) from Print
 };
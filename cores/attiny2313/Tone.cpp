@@ -16,6 +16,7 @@
 #include <avr/pgmspace.h>
 #include <avr/io.h>
 #include "wiring.h"
+#include "wiring_private.h"
 #include "pins_platoboard2313.h"
 
 #ifndef sbi
@@ -37,7 +38,7 @@
 //  < 0 - infinitely (until stop() method called, or new play() called)
 
 volatile long timer0_toggle_count;
-volatile uint8_t *timer0_pin_port;
+volatile uint8_t *timer0_pin_input;
 volatile uint8_t timer0_pin_mask;
 
 #if USE_NEW_TONE
@@ -72,7 +73,7 @@ void tone(uint8_t _pin, unsigned int frequency, unsigned long duration)
   if (pinUsed != _pin) 
     return; // We hit a race condition, and lost.
 
-  timer0_pin_port = portOutputRegister(digitalPinToPort(_pin));
+  timer0_pin_input = portInputRegister(digitalPinToPort(_pin));
   timer0_pin_mask = digitalPinToBitMask(_pin);
 
   // Set the pinMode as OUTPUT // XXX TODO Make idempotent
@@ -116,7 +117,7 @@ void tone(uint8_t _pin, unsigned int frequency, unsigned long duration)
     return; // We hit a race condition, and lost.
 
 
-  timer0_pin_port = portOutputRegister(digitalPinToPort(_pin));
+  timer0_pin_input = portInputRegister(digitalPinToPort(_pin));
   timer0_pin_mask = digitalPinToBitMask(_pin);
 
   // Set the pinMode as OUTPUT // XXX TODO Make idempotent
@@ -176,6 +177,10 @@ void noTone(uint8_t _pin)
 // Actual Interrupt handler
 ISR(TIMER0_COMPA_vect)
 {
+  // OCR0A before the handler moves it on: the match that brought us
+  // here
+  ISR_PROFILE_ENTER_MATCH(OCR0A);
+
   if (ocr_left < 15) {
     if (real_ocr > 255) {
       OCR0A = 255;
@@ -183,8 +188,9 @@ ISR(TIMER0_COMPA_vect)
     }
 
     if (timer0_toggle_count != 0)  {
-      // toggle the pin
-      *timer0_pin_port ^= timer0_pin_mask;
+      // toggle the pin; writing PINx flips just this bit, so a
+      // digitalWrite() to another pin on the port can't be undone
+      *timer0_pin_input = timer0_pin_mask;
     
       if (timer0_toggle_count > 0)
 	timer0_toggle_count--;
@@ -202,4 +208,6 @@ ISR(TIMER0_COMPA_vect)
       
     }      
   }
+
+  ISR_PROFILE_EXIT(ISR_PROF_TIMER0_COMPA);
 }
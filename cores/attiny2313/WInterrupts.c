@@ -88,6 +88,8 @@ void detachInterrupt(uint8_t interruptNum) {
 
 //SIGNAL(EXT_INT0_vect) {
 ISR(INT0_vect) {
+  ISR_PROFILE_ENTER();
   if(intFunc[EXTERNAL_INT_0])
     intFunc[EXTERNAL_INT_0]();
+  ISR_PROFILE_EXIT(ISR_PROF_INT0);
 }
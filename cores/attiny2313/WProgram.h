@@ -9,10 +9,16 @@
 #include <avr/interrupt.h>
 
 #include "wiring.h"
+#include "Task.h"
+#include "IsrProfile.h"
+#include "Modbus.h"
 #include "WCharacter.h"
 #include "WString.h"
 #ifdef __cplusplus
 #include "TinySerial.h"
+#include "PinGroup.h"
+#include "SlipFrame.h"
+#include "CommandShell.h"
 
 uint16_t makeWord(uint16_t w);
 uint16_t makeWord(byte h, byte l);
@@ -32,4 +38,6 @@ long map(long, long, long, long, long);
 
 #endif
 
+#include "wiring_fast.h"
+
 #endif
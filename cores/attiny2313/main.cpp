@@ -8,8 +8,19 @@ int main(void)
 
   setup();
     
-  for (;;)
+  for (;;) {
+#if USE_TASKS
+    taskRunAll();
+#else
     loop();
+#endif
+#if SOFT_TIMER_COUNT
+    softTimerDispatch();
+#endif
+#if MODBUS_SLAVE
+    modbusPoll();
+#endif
+  }
         
   return 0;
 }
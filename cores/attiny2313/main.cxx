@@ -4,8 +4,19 @@
 
   setup();
     
-  for (;;)
+  for (;;) {
+#if USE_TASKS
+    taskRunAll();
+#else
     loop();
+#endif
+#if SOFT_TIMER_COUNT
+    softTimerDispatch();
+#endif
+#if MODBUS_SLAVE
+    modbusPoll();
+#endif
+  }
         
   return 0;
 }
@@ -65,65 +65,24 @@
 // (PWM+ indicates the additional PWM pins on the ATmega168.)
 
 
-#define PA 0 // Unused, but is the port underlying the XTAL pins
-#define PB 1
-#define PD 2
-
-// these arrays map port names (e.g. port B) to the
-// appropriate addresses for various functions (e.g. reading
-// and writing)
-const uint8_t PROGMEM port_to_mode_PGM[] = {
-  NOT_A_PORT,
-  &DDRB,
-  &DDRD,
-};
-
-const uint8_t PROGMEM port_to_output_PGM[] = {
-  NOT_A_PORT,
-  &PORTB,
-  &PORTD,
-};
-
-const uint8_t PROGMEM port_to_input_PGM[] = {
-  NOT_A_PIN,
-  &PINB,
-  &PIND
-};
-
-const uint8_t PROGMEM digital_pin_to_port_PGM[] = {
-
-  // 7 PD entries
-  PD, PD, PD, PD, 
-  PD, PD, PD,
-
-  // 8 PBs
-  PB, PB, PB, PB,
-  PB, PB, PB, PB,
-};
-
-const uint8_t PROGMEM digital_pin_to_bit_mask_PGM[] = {
-  _BV(0), _BV(1), _BV(2), _BV(3),
-  _BV(4), _BV(5), _BV(6),
-
-  _BV(0), _BV(1), _BV(2), _BV(3),
-  _BV(4), _BV(5), _BV(6), _BV(7),
-};
-
-const uint8_t PROGMEM digital_pin_to_timer_PGM[] = {
-  NOT_ON_TIMER, // 0
-  NOT_ON_TIMER,
-  NOT_ON_TIMER,
-  NOT_ON_TIMER,
-  NOT_ON_TIMER,
-  TIMER0B, // 5: OC0B
-  NOT_ON_TIMER,
-
-  NOT_ON_TIMER, // 7
-  NOT_ON_TIMER,
-  TIMER0A, // 9: OC0A
-  TIMER1A, // 10: OC1A
-  TIMER1B, // 11: OC1B
-  NOT_ON_TIMER,
-  NOT_ON_TIMER,
-  NOT_ON_TIMER, // 14
+// One descriptor per pin; see PIN_DESC() in pins_platoboard2313.h.
+// This replaces separate port, bit mask and timer tables (plus three
+// port-to-register tables), so each pin operation is one flash read.
+const uint16_t PROGMEM digital_pin_to_desc_PGM[] = {
+  PIN_DESC(PD, 0, NOT_ON_TIMER), // 0
+  PIN_DESC(PD, 1, NOT_ON_TIMER),
+  PIN_DESC(PD, 2, NOT_ON_TIMER),
+  PIN_DESC(PD, 3, NOT_ON_TIMER),
+  PIN_DESC(PD, 4, NOT_ON_TIMER),
+  PIN_DESC(PD, 5, TIMER0B),      // 5: OC0B
+  PIN_DESC(PD, 6, NOT_ON_TIMER),
+
+  PIN_DESC(PB, 0, NOT_ON_TIMER), // 7
+  PIN_DESC(PB, 1, NOT_ON_TIMER),
+  PIN_DESC(PB, 2, TIMER0A),      // 9: OC0A
+  PIN_DESC(PB, 3, TIMER1A),      // 10: OC1A
+  PIN_DESC(PB, 4, TIMER1B),      // 11: OC1B
+  PIN_DESC(PB, 5, NOT_ON_TIMER),
+  PIN_DESC(PB, 6, NOT_ON_TIMER),
+  PIN_DESC(PB, 7, NOT_ON_TIMER), // 14
 };
@@ -40,39 +40,78 @@
 #ifndef pins_platoboard2313_h
 #define pins_platoboard2313_h
 
+#include <avr/io.h>
 #include <avr/pgmspace.h>
 
 #define NOT_A_PIN 0
 #define NOT_A_PORT 0
 
+// Port numbers, as returned by digitalPinToPort().
+#define PA 0 // Unused, but is the port underlying the XTAL pins
+#define PB 1
+#define PD 2
+
+// Timer channels are one bit each, so that a set of them fits in a
+// byte; see pwm_attached in wiring_digital.c.
 #define NOT_ON_TIMER 0
-#define TIMER0A 1
-#define TIMER0B 2
-#define TIMER1A 3
-#define TIMER1B 4
+#define TIMER0A 0x01
+#define TIMER0B 0x02
+#define TIMER1A 0x04
+#define TIMER1B 0x08
+
+// Each pin is described by one word in digital_pin_to_desc_PGM:
+//
+//   bits 0-7   bit mask within the port
+//   bits 8-11  timer channel (TIMER0A etc.), or NOT_ON_TIMER
+//   bits 12-15 port (PB or PD)
+//
+// so a pin operation costs one pgm_read_word.  Use PIN_DESC() to
+// build entries.
+#define PIN_DESC(port, bit, timer) ( _BV(bit) | ((timer) << 8) | ((port) << 12) )
 
-//changed it to uint16_t to uint8_t
-extern const uint8_t PROGMEM port_to_mode_PGM[];
-extern const uint8_t PROGMEM port_to_input_PGM[];
-extern const uint8_t PROGMEM port_to_output_PGM[];
+extern const uint16_t PROGMEM digital_pin_to_desc_PGM[];
 
-extern const uint8_t PROGMEM digital_pin_to_port_PGM[];
-// extern const uint8_t PROGMEM digital_pin_to_bit_PGM[];
-extern const uint8_t PROGMEM digital_pin_to_bit_mask_PGM[];
-extern const uint8_t PROGMEM digital_pin_to_timer_PGM[];
+#define digitalPinToDesc(P) ( pgm_read_word( digital_pin_to_desc_PGM + (P) ) )
+#define pinDescBitMask(D) ( (uint8_t)(D) )
+#define pinDescTimer(D) ( (uint8_t)((D) >> 8) & 0x0F )
+#define pinDescPort(D) ( (uint8_t)((D) >> 12) )
 
 // Get the bit location within the hardware port of the given virtual pin.
 // This comes from the pins_*.c file for the active board configuration.
 // 
 // These perform slightly better as macros compared to inline functions
 //
-#define digitalPinToPort(P) ( pgm_read_byte( digital_pin_to_port_PGM + (P) ) )
-#define digitalPinToBitMask(P) ( pgm_read_byte( digital_pin_to_bit_mask_PGM + (P) ) )
-#define digitalPinToTimer(P) ( pgm_read_byte( digital_pin_to_timer_PGM + (P) ) )
+#define digitalPinToPort(P) pinDescPort( digitalPinToDesc(P) )
+#define digitalPinToBitMask(P) pinDescBitMask( digitalPinToDesc(P) )
+#define digitalPinToTimer(P) pinDescTimer( digitalPinToDesc(P) )
 #define analogInPinToBit(P) (P)
-// in the following lines modified pgm_read_word in pgm_read_byte, word doesn't work on attiny45
-#define portOutputRegister(P) ( (volatile uint8_t *)( pgm_read_byte( port_to_output_PGM + (P))) )
-#define portInputRegister(P) ( (volatile uint8_t *)( pgm_read_byte( port_to_input_PGM + (P))) )
-#define portModeRegister(P) ( (volatile uint8_t *)( pgm_read_byte( port_to_mode_PGM + (P))) )
+
+// There are only two ports, so the registers are picked arithmetically
+// rather than looked up in flash.
+#define portOutputRegister(P) ( (P) == PB ? &PORTB : &PORTD )
+#define portInputRegister(P) ( (P) == PB ? &PINB : &PIND )
+#define portModeRegister(P) ( (P) == PB ? &DDRB : &DDRD )
+
+// Compile-time pin traits.  These say the same thing as the table in
+// pins_platoboard2313.c, but as arithmetic on the pin number, so when
+// P is a constant they fold down to a fixed register and bit and the
+// compiler can emit a single sbi/cbi/sbis.  Keep them in step with
+// the tables.
+//
+// Pins 0-6 are PD0-PD6, pins 7-14 are PB0-PB7.
+#define NUM_DIGITAL_PINS 15
+
+#define digitalPinToBitConst(P) ( (P) < 7 ? (P) : (P) - 7 )
+#define digitalPinToOutputRegConst(P) ( (P) < 7 ? &PORTD : &PORTB )
+#define digitalPinToInputRegConst(P) ( (P) < 7 ? &PIND : &PINB )
+#define digitalPinToModeRegConst(P) ( (P) < 7 ? &DDRD : &DDRB )
+#define portOutputRegConst(P) portOutputRegister(P)
+#define portInputRegConst(P) portInputRegister(P)
+#define portModeRegConst(P) portModeRegister(P)
+#define digitalPinToTimerConst(P) ( (P) == 5 ? TIMER0B :   \
+                                    (P) == 9 ? TIMER0A :   \
+                                    (P) == 10 ? TIMER1A :  \
+                                    (P) == 11 ? TIMER1B :  \
+                                    NOT_ON_TIMER )
 
 #endif // ndef pins_platoboard2313_h
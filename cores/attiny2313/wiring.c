@@ -37,23 +37,69 @@
 
 #include "wiring_private.h"
 
-// the prescaler is set so that timer0 ticks every 64 clock cycles, and the
-// the overflow handler is called every 256 ticks.
-#define MICROSECONDS_PER_TIMER0_OVERFLOW (clockCyclesToMicroseconds(64 * 256))
-
-
-// the whole number of milliseconds per timer0 overflow
-#define MILLIS_INC (MICROSECONDS_PER_TIMER0_OVERFLOW / 1000)
-
-// the fractional number of milliseconds per timer0 overflow. we shift right
-// by three to fit these numbers into a byte. (for the clock speeds we care
-// about - 8 and 16 MHz - this doesn't lose precision.)
-#define FRACT_INC ((MICROSECONDS_PER_TIMER0_OVERFLOW % 1000) >> 3)
-#define FRACT_MAX (1000 >> 3)
+// Timer 0 ticks every 64 clock cycles and overflows every 256 ticks.
+// The constants below are worked out from F_CPU as exact fractions, so
+// millis() and micros() don't drift at any clock that is a multiple of
+// 64 Hz: crystal clocks such as 14.7456 MHz included.
+#if F_CPU % 64
+#error "F_CPU must be a multiple of 64"
+#endif
+#define TIMER0_HZ (F_CPU / 64)
+
+// the largest powers of 2 and of 5 that divide TIMER0_HZ; the factors
+// it can share with a power of ten
+#define TIMER0_HZ_POW2 ((TIMER0_HZ) & -(TIMER0_HZ))
+#define TIMER0_HZ_POW5                                                  \
+  (TIMER0_HZ % 15625 == 0 ? 15625L : TIMER0_HZ % 3125 == 0 ? 3125L :    \
+   TIMER0_HZ % 625 == 0 ? 625L : TIMER0_HZ % 125 == 0 ? 125L :          \
+   TIMER0_HZ % 25 == 0 ? 25L : TIMER0_HZ % 5 == 0 ? 5L : 1L)
+
+// An overflow is 256000 / TIMER0_HZ ms (256000 = 2^11 * 5^3): MILLIS_INC
+// whole milliseconds and FRACT_INC / FRACT_MAX of one, in lowest terms.
+#define MILLIS_GCD (min(TIMER0_HZ_POW2, 2048L) * min(TIMER0_HZ_POW5, 125L))
+#define MILLIS_INC (256000L / TIMER0_HZ)
+#define FRACT_INC ((256000L % TIMER0_HZ) / MILLIS_GCD)
+#define FRACT_MAX (TIMER0_HZ / MILLIS_GCD)
+
+// millis() adds up to FRACT_MAX - 1 to a fraction that is already
+// below FRACT_MAX, so 2 * FRACT_MAX - 2 has to fit an unsigned int.
+#if FRACT_MAX > 32767
+#error "millis() can't keep exact time at this F_CPU"
+#endif
 
+// A tick is MICROS_NUM / MICROS_DEN us (1000000 = 2^6 * 5^6), in lowest
+// terms.  At 1, 8 and 16 MHz MICROS_DEN is 1 and micros() is just a
+// shift.
+#define MICROS_GCD (min(TIMER0_HZ_POW2, 64L) * min(TIMER0_HZ_POW5, 15625L))
+#define MICROS_NUM (1000000L / MICROS_GCD)
+#define MICROS_DEN (TIMER0_HZ / MICROS_GCD)
+
+// The overflow handler does nothing but count; millis() works out the
+// time from the count when it is asked.  timer0_millis and
+// timer0_fract are what the old handler would have accumulated by the
+// time timer0_overflow_count reached timer0_millis_count, and millis()
+// brings them up to date.
 volatile unsigned long timer0_overflow_count = 0;
-volatile unsigned long timer0_millis = 0;
-static unsigned char timer0_fract = 0;
+static unsigned long timer0_millis = 0;
+static unsigned int timer0_fract = 0;
+static unsigned long timer0_millis_count = 0;
+
+// Where MICROS_DEN isn't 1 micros() keeps a running total the same
+// way, as the tick count would wrap at 2^32 ticks, a few hours before
+// the microseconds do.  timer0_micros, plus timer0_micros_rem /
+// MICROS_DEN, was the time in microseconds when
+// timer0_overflow_count reached timer0_micros_count.  An overflow is
+// MICROS_OVF_US microseconds and MICROS_OVF_REM / MICROS_DEN.
+#if !MICROS_USE_TIMER1 && MICROS_DEN > 1
+#if MICROS_DEN > 65535
+#error "micros() can't keep exact time at this F_CPU"
+#endif
+#define MICROS_OVF_US (256 * MICROS_NUM / MICROS_DEN)
+#define MICROS_OVF_REM (256 * MICROS_NUM % MICROS_DEN)
+static unsigned long timer0_micros = 0;
+static unsigned int timer0_micros_rem = 0;
+static unsigned long timer0_micros_count = 0;
+#endif
 
 #if BLINK_ON_UNHANDLED_ISR
 // This is a kinda handy debug trick.
@@ -64,33 +110,116 @@ ISR(BADISR_vect) {
 
 #endif
 
-ISR(TIMER0_OVF_vect) {
-  // copy these to local variables so they can be stored in registers
-  // (volatile variables must be read from memory on every access)
-  unsigned long m = timer0_millis;
-  unsigned char f = timer0_fract;
-
-  m += MILLIS_INC;
-  f += FRACT_INC;
-  if (f >= FRACT_MAX) {
-    f -= FRACT_MAX;
-    m += 1;
+// Overflow handlers that just bump a 32-bit count.  Hand-written so
+// that all they save is r24 and SREG, and those in GPIOR1 and GPIOR2
+// rather than on the stack.  That's 17 cycles including the reti (6
+// more for each carry into the next byte), where the C version pushed
+// and popped a dozen registers.  GPIOR1 and GPIOR2 are reserved for
+// this; sketches must leave them alone.
+#define OVERFLOW_COUNT_ISR(vect, count)                                 \
+  ISR(vect, ISR_NAKED)                                                  \
+  {                                                                     \
+    asm volatile (                                                      \
+      "out %[r24], r24"                 "\n\t"                          \
+      "in r24, __SREG__"                "\n\t"                          \
+      "out %[sreg], r24"                "\n\t"                          \
+      "lds r24, " #count                "\n\t"                          \
+      "inc r24"                         "\n\t"                          \
+      "sts " #count ", r24"             "\n\t"                          \
+      "brne 1f"                         "\n\t"                          \
+      "lds r24, " #count "+1"           "\n\t"                          \
+      "inc r24"                         "\n\t"                          \
+      "sts " #count "+1, r24"           "\n\t"                          \
+      "brne 1f"                         "\n\t"                          \
+      "lds r24, " #count "+2"           "\n\t"                          \
+      "inc r24"                         "\n\t"                          \
+      "sts " #count "+2, r24"           "\n\t"                          \
+      "brne 1f"                         "\n\t"                          \
+      "lds r24, " #count "+3"           "\n\t"                          \
+      "inc r24"                         "\n\t"                          \
+      "sts " #count "+3, r24"           "\n\t"                          \
+      "1: in r24, %[sreg]"              "\n\t"                          \
+      "out __SREG__, r24"               "\n\t"                          \
+      "in r24, %[r24]"                  "\n\t"                          \
+      "reti"                                                            \
+      :: [r24] "I" (_SFR_IO_ADDR(GPIOR1)),                              \
+         [sreg] "I" (_SFR_IO_ADDR(GPIOR2))                              \
+    );                                                                  \
   }
 
-  timer0_fract = f;
-  timer0_millis = m;
+#if SOFT_TIMER_COUNT || ISR_PROFILE
+// The software timers and the profiler need a proper C handler.
+ISR(TIMER0_OVF_vect)
+{
+  ISR_PROFILE_ENTER();
   timer0_overflow_count++;
+#if SOFT_TIMER_COUNT
+  softTimerTick();
+#endif
+  ISR_PROFILE_EXIT(ISR_PROF_TIMER0_OVF);
 }
+#else
+OVERFLOW_COUNT_ISR(TIMER0_OVF_vect, timer0_overflow_count)
+#endif
+
+#if MICROS_USE_TIMER1
+volatile unsigned long timer1_overflow_count = 0;
+
+OVERFLOW_COUNT_ISR(TIMER1_OVF_vect, timer1_overflow_count)
+#endif
+
+// Run n overflows' worth of the old handler in one step.  The sums
+// come out exactly as n single steps would, so millis() rolls over
+// just as it always did.
+#define TIMER0_ADVANCE(n) do {                          \
+    m += (n) * MILLIS_INC + ((n) * FRACT_INC) / FRACT_MAX;      \
+    f += ((n) * FRACT_INC) % FRACT_MAX;                 \
+    if (f >= FRACT_MAX) {                               \
+      f -= FRACT_MAX;                                   \
+      m += 1;                                           \
+    }                                                   \
+  } while (0)
 
 unsigned long millis()
 {
-  unsigned long m;
+  unsigned long m, c, n;
+  unsigned int f;
+  unsigned int n16;
+  uint8_t n8;
   uint8_t oldSREG = SREG;
 
-  // disable interrupts while we read timer0_millis or we might get an
-  // inconsistent value (e.g. in the middle of a write to timer0_millis)
+  // disable interrupts while we read the count and our saved state,
+  // or we might get an inconsistent value (e.g. in the middle of an
+  // update from the overflow handler, or from another caller)
   cli();
   m = timer0_millis;
+  f = timer0_fract;
+  c = timer0_millis_count;
+  n = timer0_overflow_count - c;
+  SREG = oldSREG;
+
+  if (n == 0)
+    return m;
+  c += n;
+
+  // the big steps only run if nobody has asked for the time in a while
+  while (n >= 65536) {
+    TIMER0_ADVANCE(65536UL);
+    n -= 65536;
+  }
+  n16 = n;
+  while (n16 >= 256) {
+    TIMER0_ADVANCE(256UL);
+    n16 -= 256;
+  }
+  n8 = n16;
+  while (n8--)
+    TIMER0_ADVANCE(1UL);
+
+  cli();
+  timer0_millis = m;
+  timer0_fract = f;
+  timer0_millis_count = c;
   SREG = oldSREG;
 
   return m;
@@ -100,80 +229,201 @@ unsigned long millis()
 // for the ATTiny instruction set.
 
 
+#if MICROS_USE_TIMER1
 unsigned long micros() {
-  unsigned long m, t;
+  unsigned long m;
+  unsigned int t;
+  uint8_t oldSREG = SREG;
+
+  cli();
+  t = TCNT1;
+  m = timer1_overflow_count;
+
+  // an overflow that hasn't been counted yet happened before we read
+  // TCNT1 if TCNT1 has only just started again
+  if ((TIFR & _BV(TOV1)) && (t < 0x8000))
+    m++;
+  SREG = oldSREG;
+
+  return (m << (16 - TIMER1_US_SHIFT)) | (t >> TIMER1_US_SHIFT);
+}
+#elif MICROS_DEN == 1
+unsigned long micros() {
+  unsigned long m;
+  uint8_t t;
   uint8_t oldSREG = SREG;
 	
   cli();	
   t = TCNT0;
-  
+  m = timer0_overflow_count;
+
+  // An overflow that hasn't been counted yet belongs before our TCNT0
+  // reading if TCNT0 has only just started again.  (Checking for t
+  // == 0 alone missed it once TCNT0 had moved on.)
 #ifdef TIFR0
-  if ((TIFR0 & _BV(TOV0)) && (t == 0))
-    t = 256;
+  if ((TIFR0 & _BV(TOV0)) && (t < 128))
+    m++;
 #else
-  if ((TIFR & _BV(TOV0)) && (t == 0))
-    t = 256;
+  if ((TIFR & _BV(TOV0)) && (t < 128))
+    m++;
 #endif
-
-  m = timer0_overflow_count;
   SREG = oldSREG;
 	
-  return ((m << 8) + t) * (64 / clockCyclesPerMicrosecond());
+  return ((m << 8) + t) * MICROS_NUM;
 }
+#else
+unsigned long micros() {
+  unsigned long m, n, c;
+  unsigned long r;
+  uint8_t t, pending = 0;
+  uint8_t oldSREG = SREG;
+
+  cli();
+  t = TCNT0;
+  n = timer0_overflow_count;
+  m = timer0_micros;
+  r = timer0_micros_rem;
+  c = timer0_micros_count;
+
+  // a pending overflow, as above; it is left out of the total, which
+  // only goes as far as the handler has counted
+#ifdef TIFR0
+  if ((TIFR0 & _BV(TOV0)) && (t < 128))
+    pending = 1;
+#else
+  if ((TIFR & _BV(TOV0)) && (t < 128))
+    pending = 1;
+#endif
+  SREG = oldSREG;
+
+  // n overflows are n / MICROS_DEN * 256 * MICROS_NUM microseconds
+  // exactly, and then what the other n % MICROS_DEN come to; that way
+  // round nothing overflows, and the total wraps at 2^32 as it should.
+  n -= c;
+  if (n) {
+    c += n;
+    m += n * MICROS_OVF_US + n / MICROS_DEN * MICROS_OVF_REM;
+    r += n % MICROS_DEN * MICROS_OVF_REM;
+    m += r / MICROS_DEN;
+    r %= MICROS_DEN;
+
+    cli();
+    timer0_micros = m;
+    timer0_micros_rem = r;
+    timer0_micros_count = c;
+    SREG = oldSREG;
+  }
 
+  if (pending) {
+    m += MICROS_OVF_US;
+    r += MICROS_OVF_REM;
+  }
+  return m + (r + t * MICROS_NUM) / MICROS_DEN;
+}
+#endif
+
+// delay() and delayUntil() sleep in idle mode between checks, so the
+// timers, the UART and pin interrupts all carry on while the CPU waits.
+// millis() only moves in the timer 0 overflow interrupt, and each
+// check is made with interrupts off and sleepIdle() turns them back on
+// together with the sleep, so a tick can't slip in between and leave
+// us asleep through it.  Called with interrupts off, they spin as
+// delay() always did rather than turn interrupts on.
 void delay(unsigned long ms)
 {
+  uint8_t oldSREG = SREG;
   unsigned long start = millis();
-	
-  while (millis() - start <= ms)
-    ;
+
+  for (;;) {
+    cli();
+    if (millis() - start > ms)
+      break;
+    if (oldSREG & _BV(SREG_I))
+      sleepIdle();
+  }
+  SREG = oldSREG;
+}
+
+// Wait until millis() reaches when (up to 2^31 ms ahead); returns at
+// once if it already has.  Stepping when by a fixed period gives a
+// loop that runs at that rate without drifting.
+void delayUntil(unsigned long when)
+{
+  uint8_t oldSREG = SREG;
+
+  for (;;) {
+    cli();
+    if ((long)(millis() - when) >= 0)
+      break;
+    if (oldSREG & _BV(SREG_I))
+      sleepIdle();
+  }
+  SREG = oldSREG;
 }
 
-/* Delay for the given number of microseconds.  Assumes a 8 or 16 MHz clock. 
- * Disables interrupts, which will disrupt the millis() function if used
- * too frequently. */
+/* Delay for the given number of microseconds.  Tuned to the cycle for
+ * 1, 8, 12, 16 and 20 MHz; any other clock takes a scaled path that
+ * comes out a few microseconds long on short delays.  Delays up to
+ * DELAY_US_CLI_MAX run with interrupts off, so nothing can stretch
+ * them; longer ones leave interrupts on and watch micros(), so they
+ * are only as exact as its resolution.  wiring_fast.h expands a
+ * constant delay inline, and only sends it here if it is one of the
+ * long ones. */
 void delayMicroseconds(unsigned int us)
 {
   uint8_t oldSREG;
 
-  // calling avrlib's delay_us() function with low values (e.g. 1 or
-  // 2 microseconds) gives delays longer than desired.
-  //delay_us(us);
+#if DELAY_US_CLI_MAX < 65535
+  if (us > DELAY_US_CLI_MAX) {
+    unsigned long start = micros();
 
-#if F_CPU >= 16000000L
-  // for the 16 MHz clock on most Arduino boards
-
-  // for a one-microsecond delay, simply return.  the overhead
-  // of the function call yields a delay of approximately 1 1/8 us.
-  if (--us == 0)
+    while (micros() - start < us)
+      ;
     return;
+  }
+#endif
 
-  // the following loop takes a quarter of a microsecond (4 cycles)
-  // per iteration, so execute it four times for each microsecond of
-  // delay requested.
-  us <<= 2;
+  // Each count below is for the 4-cycle loop at the end, less what the
+  // call, the test above, the arithmetic and the SREG handling cost.
 
-  // account for the time taken in the preceeding commands.
-  us -= 2;
-#else
-  // for the 8 MHz internal clock on the ATmega168
-
-  // for a one- or two-microsecond delay, simply return.  the overhead of
-  // the function calls takes more than two microseconds.  can't just
-  // subtract two, since us is unsigned; we'd overflow.
-  if (--us == 0)
+#if F_CPU == 20000000L
+  // 5 loops per microsecond; about 28 cycles of overhead
+  if (us <= 1)
     return;
-  if (--us == 0)
+  us = (us << 2) + us;
+  us -= 7;
+#elif F_CPU == 16000000L
+  // 4 loops per microsecond; about 24 cycles of overhead
+  if (us <= 1)
+    return;
+  us <<= 2;
+  us -= 6;
+#elif F_CPU == 12000000L
+  // 3 loops per microsecond; about 24 cycles of overhead.  Stop at 2
+  // us, where the count would come out 0 and the loop run 65536 times.
+  if (us <= 2)
+    return;
+  us = (us << 1) + us;
+  us -= 6;
+#elif F_CPU == 8000000L
+  // 2 loops per microsecond; about 22 cycles of overhead
+  if (us <= 3)
     return;
-
-  // the following loop takes half of a microsecond (4 cycles)
-  // per iteration, so execute it twice for each microsecond of
-  // delay requested.
   us <<= 1;
-    
-  // partially compensate for the time taken by the preceeding commands.
-  // we can't subtract any more than this or we'd overflow w/ small delays.
-  us--;
+  us -= 5;
+#elif F_CPU == 1000000L
+  // a loop is 4 microseconds; the overhead alone is about 24
+  if (us <= 28)
+    return;
+  us = (us - 24) >> 2;
+#else
+  // F_CPU / 4 MHz loops per microsecond in 8.8 fixed point.  The
+  // multiply is a library call on these parts (no MUL instruction),
+  // which is what makes short delays come out long.
+  us = ((unsigned long) us * (F_CPU / 15625L)) >> 8;
+  if (us <= 25)
+    return;
+  us -= 25;
 #endif
 
   // disable interrupts, otherwise the timer 0 overflow interrupt that
@@ -213,6 +463,17 @@ void init()
   // enable timer 0 overflow interrupt
   sbi(TIMSK, TOIE0);
 
+#if MICROS_USE_TIMER1
+  // timer 1 belongs to micros(): normal mode, free running
+  TCCR1A = 0;
+  TCCR1B = TIMER1_CS;
+  sbi(TIMSK, TOIE1);
+#elif ISR_PROFILE || MODBUS_SLAVE
+  // timer 1 times the interrupt handlers or the gaps between Modbus
+  // frames: normal mode, one tick a cycle
+  TCCR1A = 0;
+  TCCR1B = TIMER1_CS;
+#else
   // timers 1 are used for phase-correct hardware pwm
   // this is better for motors as it ensures an even waveform
   // note, however, that fast pwm mode can achieve a frequency of up
@@ -229,6 +490,7 @@ void init()
   cbi(TCCR1B, WGM12);
   cbi(TCCR1A, WGM11);
   sbi(TCCR1A, WGM10);
+#endif
 
   // Disable analog comparator; it's more confusing than helpful.
   cbi(ACSR, ACD);	
@@ -101,6 +101,62 @@ extern "C"{
 #define clockCyclesToMicroseconds(a) ( (a) / clockCyclesPerMicrosecond() )
 #define microsecondsToClockCycles(a) ( (a) * clockCyclesPerMicrosecond() )
 
+  // Build with -DMICROS_USE_TIMER1=1 to hand timer 1 to micros(): it
+  // then counts in 1 us steps instead of 8 us (at 8 MHz); timer 1
+  // runs faster than that at 2, 4 and 16 MHz, but micros() still
+  // rounds down to whole microseconds.  Timer 1 is 16 bits, so it
+  // only overflows every 16 to 65 ms.  analogWrite() on the timer 1
+  // pins falls back to digitalWrite().
+#ifndef MICROS_USE_TIMER1
+#define MICROS_USE_TIMER1 0
+#endif
+
+  // Number of software timers (see wiring_timer.c).  With none, the
+  // timer 0 overflow handler stays a bare counter.
+#ifndef SOFT_TIMER_COUNT
+#define SOFT_TIMER_COUNT 0
+#endif
+
+  // Build with -DUSE_TASKS=1 to have main() run the tasks of Task.h
+  // instead of calling loop().
+#ifndef USE_TASKS
+#define USE_TASKS 0
+#endif
+
+  // delayMicroseconds() keeps interrupts off for delays up to this
+  // many us, so they come out exact.  By default that's every delay,
+  // as it always was.  Build with a smaller figure, such as
+  // -DDELAY_US_CLI_MAX=500, to have longer delays leave interrupts on,
+  // so millis() and the UART keep up; they then time themselves with
+  // micros() and are only good to its 8 us steps (64 us at 1 MHz).
+#ifndef DELAY_US_CLI_MAX
+#define DELAY_US_CLI_MAX 65535
+#endif
+
+  // Build with -DISR_PROFILE=1 to have the core's interrupt handlers
+  // time themselves (see IsrProfile.h).  Timer 1 is the clock, so
+  // unless MICROS_USE_TIMER1 already has it, it runs free at F_CPU and
+  // analogWrite() on its pins falls back to digitalWrite().
+#ifndef ISR_PROFILE
+#define ISR_PROFILE 0
+#endif
+
+  // Build with -DMODBUS_SLAVE=1 for a Modbus RTU slave on the UART
+  // (see Modbus.h).  Frames end at 3.5 characters of silence, timed
+  // by timer 1's compare B, so timer 1 runs free as for ISR_PROFILE.
+#ifndef MODBUS_SLAVE
+#define MODBUS_SLAVE 0
+#endif
+
+  // softTimerStart() flags
+#define SOFT_TIMER_ONESHOT 0x00
+#define SOFT_TIMER_PERIODIC 0x01
+#define SOFT_TIMER_DEFERRED 0x02  // call back from softTimerDispatch()
+
+  // ticks (timer 0 overflows) in ms milliseconds, rounded up; free
+  // when ms is a constant
+#define softTimerMs(ms) ( (unsigned int)(((ms) * (F_CPU / 1000UL) + 64UL * 256 - 1) / (64UL * 256)) )
+
 #define lowByte(w) ((uint8_t) ((w) & 0xff))
 #define highByte(w) ((uint8_t) ((w) >> 8))
 
@@ -120,6 +176,8 @@ extern "C"{
 
   void pinMode(uint8_t, uint8_t);
   void digitalWrite(uint8_t, uint8_t);
+  void digitalWriteAtomic(uint8_t, uint8_t);
+  void digitalToggle(uint8_t);
   int digitalRead(uint8_t);
   int analogRead(uint8_t);
   void analogReference(uint8_t mode);
@@ -135,11 +193,17 @@ extern "C"{
   unsigned long millis(void);
   unsigned long micros(void);
   void delay(unsigned long);
+  void delayUntil(unsigned long);
   void delayMicroseconds(unsigned int us);
   unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout);
 
   void shiftOut(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, byte val);
 
+  void softTimerStart(uint8_t id, unsigned int ticks, uint8_t flags, void (*)(void));
+  void softTimerStop(uint8_t id);
+  uint8_t softTimerActive(uint8_t id);
+  void softTimerDispatch(void);
+
   void attachInterrupt(uint8_t, void (*)(void), int mode);
   void detachInterrupt(uint8_t);
 
@@ -60,9 +60,13 @@ void analogWrite(uint8_t pin, int val)
   // writing with them.  Also, make sure the pin is in output mode
   // for consistenty with Wiring, which doesn't require a pinMode
   // call for the analog output pins.
+  if (pin >= NUM_DIGITAL_PINS) return;
+
   pinMode(pin, OUTPUT);
 
-  switch(digitalPinToTimer(pin)) {
+  uint8_t timer = digitalPinToTimer(pin);
+
+  switch(timer) {
   case TIMER0A: 
     OCR0A = val;
     sbi(TCCR0A, COM0A1);
@@ -72,6 +76,7 @@ void analogWrite(uint8_t pin, int val)
     sbi(TCCR0A, COM0B1);
     break;
 
+#if !TIMER1_FREE_RUNNING
   case TIMER1A:
     OCR1A = val;
     sbi(TCCR1A, COM0A1);
@@ -80,7 +85,11 @@ void analogWrite(uint8_t pin, int val)
     OCR1B = val;
     sbi(TCCR1A, COM0B1);
     break;
+#endif
   default:
     digitalWrite(pin, val >= 128);
+    return;
   }
+
+  pwm_attached |= timer;
 }
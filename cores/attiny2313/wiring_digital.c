@@ -38,29 +38,37 @@
 
 void pinMode(uint8_t pin, uint8_t mode)
 {
-  uint8_t bit = digitalPinToBitMask(pin);
-  uint8_t port = digitalPinToPort(pin);
+  uint16_t desc;
+  uint8_t bit;
   volatile uint8_t *reg;
 
-  if (port == NOT_A_PIN) return;
+  if (pin >= NUM_DIGITAL_PINS) return;
 
-  reg = portModeRegister(port);
+  desc = digitalPinToDesc(pin);
+  bit = pinDescBitMask(desc);
+  reg = portModeRegister(pinDescPort(desc));
 
   if (mode == INPUT) *reg &= ~bit;
   else *reg |= bit;
 }
 
+uint8_t pwm_attached = 0;
+
 // Forcing this inline keeps the callers from having to push their own stuff
 // on the stack. It is a good performance win and only takes 1 more byte per
 // user than calling. (It will take more bytes on the 168.)
 //
-// But shouldn't this be moved into pinMode? Seems silly to check and do on
-// each digitalread or write.
+// Plain pins have a timer of NOT_ON_TIMER, which is 0, so they and timer
+// pins without PWM running both fall out at the first test; the timer
+// registers are only touched when analogWrite() has actually attached one.
 //
 
 static inline void turnOffPWM(uint8_t timer) __attribute__ ((always_inline));
 static inline void turnOffPWM(uint8_t timer)
 {
+  if (!(pwm_attached & timer)) return;
+  pwm_attached &= ~timer;
+
   switch(timer) {
   case TIMER0A: cbi(TCCR0A, COM0A1); break;
   case TIMER0B: cbi(TCCR0A, COM0B1); break;
@@ -71,16 +79,20 @@ static inline void turnOffPWM(uint8_t timer)
 
 void digitalWrite(uint8_t pin, uint8_t val)
 {
-  uint8_t timer = digitalPinToTimer(pin);
-  uint8_t bit = digitalPinToBitMask(pin);
-  uint8_t port = digitalPinToPort(pin);
+  uint16_t desc;
+  uint8_t timer, bit, port;
   volatile uint8_t *out;
 
-  if (port == NOT_A_PIN) return;
+  if (pin >= NUM_DIGITAL_PINS) return;
+
+  desc = digitalPinToDesc(pin);
+  timer = pinDescTimer(desc);
+  bit = pinDescBitMask(desc);
+  port = pinDescPort(desc);
 
-  // If the pin that support PWM output, we need to turn it off
+  // If the pin has PWM output running, we need to turn it off
   // before doing a digital write.
-  if (timer != NOT_ON_TIMER) turnOffPWM(timer);
+  turnOffPWM(timer);
 
   out = portOutputRegister(port);
 
@@ -88,17 +100,63 @@ void digitalWrite(uint8_t pin, uint8_t val)
   else *out |= bit;
 }
 
+// Like digitalWrite(), but safe against an interrupt handler that
+// writes other pins on the same port: instead of a read-modify-write of
+// PORTx, it writes the pin's bit to PINx (which toggles it in hardware)
+// only if the pin isn't already at the requested level.  No cli() is
+// needed.  Only a handler driving this very pin can still race with it.
+void digitalWriteAtomic(uint8_t pin, uint8_t val)
+{
+  uint16_t desc;
+  uint8_t timer, bit, port;
+
+  if (pin >= NUM_DIGITAL_PINS) return;
+
+  desc = digitalPinToDesc(pin);
+  timer = pinDescTimer(desc);
+  bit = pinDescBitMask(desc);
+  port = pinDescPort(desc);
+
+  turnOffPWM(timer);
+
+  if (!(*portOutputRegister(port) & bit) != (val == LOW))
+    *portInputRegister(port) = bit;
+}
+
+// Writing a 1 to a PINx bit toggles the matching PORTx bit, so this is
+// a single store with nothing for an interrupt to get in between.
+void digitalToggle(uint8_t pin)
+{
+  uint16_t desc;
+  uint8_t timer, bit, port;
+
+  if (pin >= NUM_DIGITAL_PINS) return;
+
+  desc = digitalPinToDesc(pin);
+  timer = pinDescTimer(desc);
+  bit = pinDescBitMask(desc);
+  port = pinDescPort(desc);
+
+  turnOffPWM(timer);
+
+  *portInputRegister(port) = bit;
+}
+
 int digitalRead(uint8_t pin)
 {
-  uint8_t timer = digitalPinToTimer(pin);
-  uint8_t bit = digitalPinToBitMask(pin);
-  uint8_t port = digitalPinToPort(pin);
+  uint16_t desc;
+  uint8_t timer, bit, port;
+
+  if (pin >= NUM_DIGITAL_PINS) return LOW;
 
-  if (port == NOT_A_PIN) return LOW;
+  desc = digitalPinToDesc(pin);
+  timer = pinDescTimer(desc);
+  bit = pinDescBitMask(desc);
+  port = pinDescPort(desc);
 
-  // If the pin that support PWM output, we need to turn it off
+  // If the pin has PWM output running, we need to turn it off
   // before getting a digital reading.
-  if (timer != NOT_ON_TIMER) turnOffPWM(timer);
+  turnOffPWM(timer);
 
   return !!(*portInputRegister(port) & bit);
 }
@@ -0,0 +1,265 @@
+/* -*- mode: C; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+/*
+  wiring_fast.h - Constant-pin fast paths for the Wiring digital API
+
+  Copyright (c) 2011 Applied Platonics.
+
+  This file is a part of the PlatoBoard, 
+  http://www.appliedplatonics.com/platoboard/
+
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General
+  Public License along with this library; if not, write to the
+  Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+  Boston, MA  02111-1307  USA
+*/
+
+#ifndef wiring_fast_h
+#define wiring_fast_h
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include "wiring.h"
+#include "pins_platoboard2313.h"
+
+// When the pin number is a compile-time constant, pinMode(),
+// digitalWrite(), digitalWriteAtomic(), digitalToggle() and
+// digitalRead() are replaced with inline code that works straight on
+// the port registers.  On a plain GPIO pin that is a single sbi/cbi or
+// sbis, where the table-driven versions make a call and look the pin
+// up in flash; bench/gpio.cpp has a row for each, (const) and (var).
+// Pins with a timer still have their PWM output switched off first if
+// analogWrite() left it running.
+//
+// Runtime pin numbers fall through to the functions in
+// wiring_digital.c, so behaviour is unchanged either way.
+//
+// This is only pulled in by WProgram.h, so the core's own sources see
+// the plain functions.
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+extern uint8_t pwm_attached;
+
+static inline void turnOffPWMConst(uint8_t timer) __attribute__ ((always_inline));
+static inline void turnOffPWMConst(uint8_t timer)
+{
+  if (!(pwm_attached & timer)) return;
+  pwm_attached &= ~timer;
+
+  switch(timer) {
+  case TIMER0A: TCCR0A &= ~_BV(COM0A1); break;
+  case TIMER0B: TCCR0A &= ~_BV(COM0B1); break;
+  case TIMER1A: TCCR1A &= ~_BV(COM0A1); break;
+  case TIMER1B: TCCR1A &= ~_BV(COM0B1); break;
+  }
+}
+
+static inline void pinModeConst(uint8_t pin, uint8_t mode) __attribute__ ((always_inline));
+static inline void pinModeConst(uint8_t pin, uint8_t mode)
+{
+  if (mode == INPUT) *digitalPinToModeRegConst(pin) &= ~_BV(digitalPinToBitConst(pin));
+  else *digitalPinToModeRegConst(pin) |= _BV(digitalPinToBitConst(pin));
+}
+
+static inline void digitalWriteConst(uint8_t pin, uint8_t val) __attribute__ ((always_inline));
+static inline void digitalWriteConst(uint8_t pin, uint8_t val)
+{
+  turnOffPWMConst(digitalPinToTimerConst(pin));
+
+  if (val == LOW) *digitalPinToOutputRegConst(pin) &= ~_BV(digitalPinToBitConst(pin));
+  else *digitalPinToOutputRegConst(pin) |= _BV(digitalPinToBitConst(pin));
+}
+
+// sbi/cbi on PORTx is a single instruction, so the constant-pin
+// digitalWrite() is already interrupt-safe.
+#define digitalWriteAtomicConst(P, V) digitalWriteConst((P), (V))
+
+static inline void digitalToggleConst(uint8_t pin) __attribute__ ((always_inline));
+static inline void digitalToggleConst(uint8_t pin)
+{
+  turnOffPWMConst(digitalPinToTimerConst(pin));
+
+  *digitalPinToInputRegConst(pin) = _BV(digitalPinToBitConst(pin));
+}
+
+static inline int digitalReadConst(uint8_t pin) __attribute__ ((always_inline));
+static inline int digitalReadConst(uint8_t pin)
+{
+  turnOffPWMConst(digitalPinToTimerConst(pin));
+
+  return (*digitalPinToInputRegConst(pin) & _BV(digitalPinToBitConst(pin))) ? HIGH : LOW;
+}
+
+// Whole-port access, for driving parallel buses without eight
+// separate digitalWrite() calls.  `port' is PB or PD, as returned by
+// digitalPinToPort(); `mask' selects bits within that port.
+//
+// Every call ends in a single write to the port register.  The
+// read-modify-write cases run with interrupts off, so an ISR touching
+// other bits of the same port can't be lost in between; if both port
+// and mask are constant and only one bit is involved, the compiler
+// uses sbi/cbi instead, which is atomic anyway.  Toggling writes the
+// mask to PINx, which the hardware turns into a toggle of exactly
+// those bits, so it never needs to block interrupts.
+
+#define portMaskIsConstBit(P, M) \
+  ( __builtin_constant_p(P) && __builtin_constant_p(M) && !((M) & ((M) - 1)) )
+
+static inline void portWrite(uint8_t port, uint8_t val) __attribute__ ((always_inline));
+static inline void portWrite(uint8_t port, uint8_t val)
+{
+  *portOutputRegConst(port) = val;
+}
+
+static inline uint8_t portRead(uint8_t port) __attribute__ ((always_inline));
+static inline uint8_t portRead(uint8_t port)
+{
+  return *portInputRegConst(port);
+}
+
+static inline void portSetMask(uint8_t port, uint8_t mask) __attribute__ ((always_inline));
+static inline void portSetMask(uint8_t port, uint8_t mask)
+{
+  uint8_t oldSREG;
+
+  if (portMaskIsConstBit(port, mask)) {
+    *portOutputRegConst(port) |= mask;
+    return;
+  }
+
+  oldSREG = SREG;
+  cli();
+  *portOutputRegConst(port) |= mask;
+  SREG = oldSREG;
+}
+
+static inline void portClearMask(uint8_t port, uint8_t mask) __attribute__ ((always_inline));
+static inline void portClearMask(uint8_t port, uint8_t mask)
+{
+  uint8_t oldSREG;
+
+  if (portMaskIsConstBit(port, mask)) {
+    *portOutputRegConst(port) &= ~mask;
+    return;
+  }
+
+  oldSREG = SREG;
+  cli();
+  *portOutputRegConst(port) &= ~mask;
+  SREG = oldSREG;
+}
+
+static inline void portToggleMask(uint8_t port, uint8_t mask) __attribute__ ((always_inline));
+static inline void portToggleMask(uint8_t port, uint8_t mask)
+{
+  *portInputRegConst(port) = mask;
+}
+
+// Set the bits in mask to the matching bits of val, leaving the rest
+// of the port alone.
+static inline void portWriteMask(uint8_t port, uint8_t mask, uint8_t val) __attribute__ ((always_inline));
+static inline void portWriteMask(uint8_t port, uint8_t mask, uint8_t val)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  *portOutputRegConst(port) = (*portOutputRegConst(port) & ~mask) | (val & mask);
+  SREG = oldSREG;
+}
+
+// pinMode() for every bit in mask at once.
+static inline void portModeMask(uint8_t port, uint8_t mask, uint8_t mode) __attribute__ ((always_inline));
+static inline void portModeMask(uint8_t port, uint8_t mask, uint8_t mode)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  if (mode == INPUT) *portModeRegConst(port) &= ~mask;
+  else *portModeRegConst(port) |= mask;
+  SREG = oldSREG;
+}
+
+// delayMicroseconds() with a constant argument: the cycle count is
+// worked out at compile time and burnt inline, with interrupts held
+// off around it just as the runtime version does.  With avr-gcc's
+// __builtin_avr_delay_cycles it is exact to the cycle, counting the
+// three cycles spent saving SREG, masking and restoring; older
+// toolchains fall back to _delay_us(), which is within a few cycles.
+#define delayMicrosecondsCycles(us) ( (unsigned long)(us) * (F_CPU / 1000UL) / 1000UL )
+
+static inline void delayMicrosecondsConst(unsigned int us) __attribute__ ((always_inline));
+static inline void delayMicrosecondsConst(unsigned int us)
+{
+  uint8_t oldSREG;
+
+  if (us == 0) return;
+
+#if DELAY_US_CLI_MAX < 65535
+  if (us > DELAY_US_CLI_MAX) {
+    delayMicroseconds(us);
+    return;
+  }
+#endif
+
+#if defined(__HAS_DELAY_CYCLES) && __HAS_DELAY_CYCLES
+  if (delayMicrosecondsCycles(us) <= 3) {
+    __builtin_avr_delay_cycles(delayMicrosecondsCycles(us));
+    return;
+  }
+
+  oldSREG = SREG;
+  cli();
+  __builtin_avr_delay_cycles(delayMicrosecondsCycles(us) - 3);
+  SREG = oldSREG;
+#else
+  oldSREG = SREG;
+  cli();
+  _delay_us(us);
+  SREG = oldSREG;
+#endif
+}
+
+// The macros name the function they replace, which is fine: the
+// preprocessor doesn't expand a macro inside its own expansion, so the
+// fallback arm is a real call.
+#define pinMode(P, M)                                                   \
+  ( __builtin_constant_p(P) && (P) < NUM_DIGITAL_PINS ?                 \
+    pinModeConst((P), (M)) : pinMode((P), (M)) )
+
+#define digitalWrite(P, V)                                              \
+  ( __builtin_constant_p(P) && (P) < NUM_DIGITAL_PINS ?                 \
+    digitalWriteConst((P), (V)) : digitalWrite((P), (V)) )
+
+#define digitalWriteAtomic(P, V)                                        \
+  ( __builtin_constant_p(P) && (P) < NUM_DIGITAL_PINS ?                 \
+    digitalWriteAtomicConst((P), (V)) : digitalWriteAtomic((P), (V)) )
+
+#define digitalToggle(P)                                                \
+  ( __builtin_constant_p(P) && (P) < NUM_DIGITAL_PINS ?                 \
+    digitalToggleConst(P) : digitalToggle(P) )
+
+#define digitalRead(P)                                                  \
+  ( __builtin_constant_p(P) && (P) < NUM_DIGITAL_PINS ?                 \
+    digitalReadConst(P) : digitalRead(P) )
+
+#define delayMicroseconds(US)                                           \
+  ( __builtin_constant_p(US) ?                                          \
+    delayMicrosecondsConst(US) : delayMicroseconds(US) )
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // ndef wiring_fast_h
@@ -38,10 +38,12 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <avr/delay.h>
+#include <avr/sleep.h>
 #include <stdio.h>
 #include <stdarg.h>
 
 #include "wiring.h"
+#include "IsrProfile.h"
 
 #ifdef __cplusplus
 extern "C"{
@@ -61,6 +63,93 @@ extern "C"{
 
   typedef void (*voidFuncPtr)(void);
 
+  // Timer channels (TIMER0A etc.) that analogWrite() has connected to
+  // their pins.  digitalWrite() and digitalRead() only touch the timer
+  // registers for a channel listed here.
+  extern uint8_t pwm_attached;
+
+  // Advance the software timers; called every timer 0 overflow.
+  void softTimerTick(void);
+
+  // Timer 1 runs free for micros(), the ISR profiler or Modbus rather
+  // than doing PWM.
+#define TIMER1_FREE_RUNNING (MICROS_USE_TIMER1 || ISR_PROFILE || MODBUS_SLAVE)
+
+  // Timer 0 always counts at F_CPU / 64; millis() depends on it.
+#define TIMER0_PRESCALE 64
+
+  // Timer 1's clock select and CPU cycles a tick, when it runs free.
+  // For micros() it counts microseconds (or a power of two fraction of
+  // one), so micros() needs nothing but shifts; otherwise every cycle.
+#if MICROS_USE_TIMER1
+#if F_CPU == 1000000L
+#define TIMER1_CS _BV(CS10)
+#define TIMER1_US_SHIFT 0
+#elif F_CPU == 2000000L
+#define TIMER1_CS _BV(CS10)
+#define TIMER1_US_SHIFT 1
+#elif F_CPU == 4000000L
+#define TIMER1_CS _BV(CS10)
+#define TIMER1_US_SHIFT 2
+#elif F_CPU == 8000000L
+#define TIMER1_CS _BV(CS11)
+#define TIMER1_US_SHIFT 0
+#elif F_CPU == 16000000L
+#define TIMER1_CS _BV(CS11)
+#define TIMER1_US_SHIFT 1
+#else
+#error "MICROS_USE_TIMER1 needs F_CPU of 1, 2, 4, 8 or 16 MHz"
+#endif
+#elif TIMER1_FREE_RUNNING
+#define TIMER1_CS _BV(CS10)
+#endif
+#define TIMER1_PRESCALE (TIMER1_CS == _BV(CS11) ? 8 : 1)
+
+  // Hand a received byte and the UCSRA it came with to the Modbus
+  // frame assembler; called from the UART receive interrupt.
+  void modbusRxByte(uint8_t c, uint8_t status);
+
+  // Bracket a handler's body to have it profiled as handler id.  The
+  // handler's own register saves and restores fall outside, and the
+  // call to isrProfileRecord() adds some of its own.
+#if ISR_PROFILE
+  void isrProfileRecord(uint8_t id, unsigned int start, uint8_t tcnt0);
+#define ISR_PROFILE_ENTER() ISR_PROFILE_ENTER_MATCH(0)
+  // For a timer 0 compare handler: ocr is what TCNT0 was at the
+  // match, so TCNT0 - ocr is how long ago it was.  Timer 0 counts on
+  // through the match in its PWM mode rather than clearing.
+#define ISR_PROFILE_ENTER_MATCH(ocr)                            \
+  unsigned int isr_profile_start = TCNT1;                       \
+  uint8_t isr_profile_tcnt0 = TCNT0 - (ocr)
+#define ISR_PROFILE_EXIT(id)                                    \
+  isrProfileRecord((id), isr_profile_start, isr_profile_tcnt0)
+#else
+#define ISR_PROFILE_ENTER()
+#define ISR_PROFILE_ENTER_MATCH(ocr)
+#define ISR_PROFILE_EXIT(id)
+#endif
+
+  // Sleep in idle mode until the next interrupt.  Interrupts are
+  // enabled on the way in; call with them off after the last check
+  // for work, and the sei/sleep pair (which can't be split by an
+  // interrupt) makes sure a wakeup in between isn't missed.  The
+  // sleep mode the sketch had set is put back afterwards.
+  static inline void sleepIdle(void) __attribute__ ((always_inline));
+  static inline void sleepIdle(void)
+  {
+    uint8_t mode = MCUCR & (_BV(SM1) | _BV(SM0));
+
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_enable();
+    sei();
+    sleep_cpu();
+    // sleep_disable() and the old mode in one go, with no handler in
+    // the middle of it
+    cli();
+    MCUCR = (MCUCR & ~(_BV(SE) | _BV(SM1) | _BV(SM0))) | mode;
+    sei();
+  }
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
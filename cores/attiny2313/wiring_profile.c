@@ -0,0 +1,90 @@
+/* -*- mode: C; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+/*
+  wiring_profile.c - interrupt handler profiler
+
+  Copyright (c) 2011 Applied Platonics.
+
+  This file is a part of the PlatoBoard,
+  http://www.appliedplatonics.com/platoboard/
+
+  Distributed under the terms of the GPL.
+
+  Build with -DISR_PROFILE=1 and the core's handlers (timer 0
+  overflow, tone()'s timer 0 compare, the UART receiver and
+  transmitter, and INT0) stamp timer 1 on the way in and out.  For
+  each one we keep how often it ran, the cycles it took in all and at
+  most, and the longest it waited to start.
+
+  The wait is only known for the timer 0 handlers: TCNT0 on entry is
+  how long ago the overflow happened, and TCNT0 - OCR0A how long ago
+  the compare match did, timer 0 counting on through it in its PWM
+  mode.  For the others it stays 0, but it can be no longer than the
+  slowest of the other handlers plus any stretch the sketch runs with
+  interrupts off.
+
+  isrProfileRead() and isrProfilePrint() (IsrProfile.h) get at the
+  figures.
+
+  RAM: 10 bytes per handler.
+*/
+
+#include <string.h>
+
+#include "wiring_private.h"
+
+#if ISR_PROFILE
+
+static struct isr_profile isr_profiles[ISR_PROF_COUNT];
+
+// Called from the handlers with interrupts off.  tcnt0 is the timer 0
+// ticks since the event, as ISR_PROFILE_ENTER_MATCH() worked out.
+void isrProfileRecord(uint8_t id, unsigned int start, uint8_t tcnt0)
+{
+  struct isr_profile *p = &isr_profiles[id];
+  unsigned long cycles;
+
+  cycles = (unsigned long) (unsigned int) (TCNT1 - start)
+    * TIMER1_PRESCALE;
+  if (cycles > 0xFFFF) cycles = 0xFFFF;
+
+  // halve the totals rather than let the count wrap, which keeps the
+  // average right
+  if (p->count == 0xFFFF) {
+    p->count >>= 1;
+    p->cycles >>= 1;
+  }
+  p->count++;
+  p->cycles += cycles;
+  if (cycles > p->max_cycles) p->max_cycles = cycles;
+
+  // at most 255 * 64, so no need to clip
+  if (id == ISR_PROF_TIMER0_OVF || id == ISR_PROF_TIMER0_COMPA) {
+    unsigned int latency = tcnt0 * TIMER0_PRESCALE;
+    if (latency > p->max_latency) p->max_latency = latency;
+  }
+}
+
+void isrProfileRead(uint8_t id, struct isr_profile *p)
+{
+  uint8_t oldSREG = SREG;
+
+  if (id >= ISR_PROF_COUNT) {
+    memset(p, 0, sizeof(*p));
+    return;
+  }
+
+  cli();
+  *p = isr_profiles[id];
+  SREG = oldSREG;
+}
+
+void isrProfileReset(void)
+{
+  uint8_t oldSREG = SREG;
+
+  cli();
+  memset(isr_profiles, 0, sizeof(isr_profiles));
+  SREG = oldSREG;
+}
+
+#endif
@@ -0,0 +1,91 @@
+/* -*- mode: C; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+/*
+  wiring_task.c - scheduler for the tasks in Task.h
+
+  Copyright (c) 2011 Applied Platonics.
+
+  This file is a part of the PlatoBoard, 
+  http://www.appliedplatonics.com/platoboard/
+
+  Distributed under the terms of the GPL.
+*/
+
+#include "wiring_private.h"
+#include "Task.h"
+
+static Task *task_list;
+uint8_t task_checking;
+
+void taskStart(Task *t, char (*fn)(Task *))
+{
+  Task *p;
+
+  t->run = fn;
+  t->lc = 0;
+
+  for (p = task_list; p; p = p->next)
+    if (p == t) return;
+
+  t->next = task_list;
+  task_list = t;
+}
+
+void taskStop(Task *t)
+{
+  Task **link;
+
+  // t->next is left alone, so a task can stop itself (or the one
+  // being run can stop it) without losing the scheduler's place
+  for (link = &task_list; *link; link = &(*link)->next) {
+    if (*link == t) {
+      *link = t->next;
+      return;
+    }
+  }
+}
+
+uint8_t taskRunAll(void)
+{
+  Task *t, **link = &task_list;
+  uint8_t busy = 0;
+  uint8_t oldSREG = SREG;
+
+  while ((t = *link)) {
+    char r = t->run(t);
+
+    if (r == TASK_WAITING) {
+      link = &t->next;
+    } else if (r == TASK_ENDED) {
+      taskStop(t);
+      busy = 1;
+    } else {
+      link = &t->next;
+      busy = 1;
+    }
+  }
+
+  if (busy)
+    return busy;
+
+  // Ask them all again with interrupts off, so that an interrupt
+  // that readies a task after its turn can't leave us asleep until
+  // the next one: sleepIdle() turns interrupts back on with the sleep.
+  // A task just started is at the top of its function, with no
+  // condition to test, and counts as ready.
+  cli();
+  task_checking = 1;
+  for (t = task_list; t; t = t->next) {
+    if (t->lc == 0 || t->run(t) != TASK_WAITING) {
+      busy = 1;
+      break;
+    }
+  }
+  task_checking = 0;
+
+  if (busy || !(oldSREG & _BV(SREG_I)))
+    SREG = oldSREG;
+  else
+    sleepIdle();
+
+  return busy;
+}
@@ -0,0 +1,121 @@
+/*
+  PinGroup.cpp - Treat a handful of pins as one parallel bus
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General
+  Public License along with this library; if not, write to the
+  Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+  Boston, MA  02111-1307  USA
+*/
+
+#include <inttypes.h>
+#include "wiring_private.h"
+#include "pins_arduino.h"
+#include "wiring_fast.h"
+
+#include "PinGroup.h"
+
+PinGroup::PinGroup(uint8_t p0, uint8_t p1, uint8_t p2,
+                   uint8_t p3, uint8_t p4, uint8_t p5)
+{
+	_count = 0;
+	_mask = 0;
+	_shift = -1;
+
+	add(p0); add(p1); add(p2);
+	add(p3); add(p4); add(p5);
+
+	// The shuffle can be skipped if the pins are one run of bits,
+	// in order, starting with the first.
+	if (_count) {
+		int8_t shift = 0;
+		while (!(_bit[0] & (1 << shift)))
+			shift++;
+
+		uint8_t i;
+		for (i = 0; i < _count; i++)
+			if (_bit[i] != (uint8_t)(1 << (shift + i)))
+				break;
+
+		if (i == _count)
+			_shift = shift;
+	}
+}
+
+void PinGroup::add(uint8_t pin)
+{
+	if (pin >= NUM_DIGITAL_PINS || _count == PINGROUP_MAX_PINS) return;
+
+	_bit[_count] = digitalPinToBitMask(pin);
+	_mask |= _bit[_count];
+	_count++;
+}
+
+// Turn a group value into the PORTB bits to drive.
+uint8_t PinGroup::spread(uint8_t value)
+{
+	uint8_t i, pb = 0;
+
+	if (_shift >= 0)
+		return (value << _shift) & _mask;
+
+	for (i = 0; i < _count; i++, value >>= 1)
+		if (value & 1) pb |= _bit[i];
+
+	return pb;
+}
+
+void PinGroup::output(void)
+{
+	portModeMask(PB, _mask, OUTPUT);
+}
+
+void PinGroup::input(void)
+{
+	portModeMask(PB, _mask, INPUT);
+}
+
+void PinGroup::write(uint8_t value)
+{
+	portWriteMask(PB, _mask, spread(value));
+}
+
+uint8_t PinGroup::read(void)
+{
+	uint8_t pb = PINB;
+	uint8_t i, value = 0;
+
+	if (_shift >= 0)
+		return (pb & _mask) >> _shift;
+
+	for (i = _count; i-- > 0; ) {
+		value <<= 1;
+		if (pb & _bit[i]) value |= 1;
+	}
+
+	return value;
+}
+
+void PinGroup::set(uint8_t bits)
+{
+	portSetMask(PB, spread(bits));
+}
+
+void PinGroup::clear(uint8_t bits)
+{
+	portClearMask(PB, spread(bits));
+}
+
+void PinGroup::toggle(uint8_t bits)
+{
+	portToggleMask(PB, spread(bits));
+}
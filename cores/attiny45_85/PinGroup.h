@@ -0,0 +1,61 @@
+/*
+  PinGroup.h - Treat a handful of pins as one parallel bus
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General
+  Public License along with this library; if not, write to the
+  Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+  Boston, MA  02111-1307  USA
+*/
+
+#ifndef PinGroup_h
+#define PinGroup_h
+
+#include <inttypes.h>
+
+#define PINGROUP_MAX_PINS 6
+#define PINGROUP_NO_PIN 255
+
+// Bit i of a value goes to the i'th pin the group was built from:
+//
+//   PinGroup nibble(1, 2, 3, 4);
+//   nibble.output();
+//   nibble.write(0x5);
+//
+// Every operation is one write to PORTB (or PINB, for toggle), so all
+// the pins change on the same clock.  Consecutive pins in order skip
+// the bit shuffling.
+class PinGroup
+{
+  public:
+    PinGroup(uint8_t p0,
+             uint8_t p1 = PINGROUP_NO_PIN, uint8_t p2 = PINGROUP_NO_PIN,
+             uint8_t p3 = PINGROUP_NO_PIN, uint8_t p4 = PINGROUP_NO_PIN,
+             uint8_t p5 = PINGROUP_NO_PIN);
+    void output(void);
+    void input(void);
+    void write(uint8_t);
+    uint8_t read(void);
+    void set(uint8_t);
+    void clear(uint8_t);
+    void toggle(uint8_t);
+  private:
+    void add(uint8_t);
+    uint8_t spread(uint8_t);
+
+    uint8_t _count;
+    uint8_t _mask;    // all port B bits in the group
+    int8_t _shift;    // >= 0: group is _count consecutive bits from here
+    uint8_t _bit[PINGROUP_MAX_PINS];
+};
+
+#endif
@@ -0,0 +1,94 @@
+/*
+	RingBuffer.h - Byte queue between an interrupt handler and the sketch
+
+	This library is free software; you can redistribute it and/or
+	modify it under the terms of the GNU Lesser General Public
+	License as published by the Free Software Foundation; either
+	version 2.1 of the License, or (at your option) any later version.
+
+	This library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+	Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General
+	Public License along with this library; if not, write to the
+	Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+	Boston, MA  02111-1307  USA
+*/
+
+#ifndef RingBuffer_h
+#define RingBuffer_h
+
+#include <inttypes.h>
+
+// A queue of SIZE bytes (a power of two, at most 128) for exactly one
+// writer and one reader, one of which may be an interrupt handler.
+//
+// head and tail are single bytes that run freely and wrap at 256, so
+// each is read and written in one instruction and no cli() is needed
+// on either side: only put() moves head, only get() moves tail, and
+// each stores the byte before publishing the index.  head - tail is
+// the number of bytes queued, so all SIZE slots can be used, and the
+// slot is the index masked with SIZE - 1.
+template <uint8_t SIZE>
+class RingBuffer
+{
+	// fails to compile unless SIZE is a power of two from 1 to 128
+	typedef char size_check[SIZE != 0 && (SIZE & (SIZE - 1)) == 0 && SIZE <= 128 ? 1 : -1];
+
+	enum { MASK = SIZE - 1 };
+
+	volatile uint8_t _buf[SIZE];
+	volatile uint8_t _head;
+	volatile uint8_t _tail;
+
+public:
+	RingBuffer() : _head(0), _tail(0) {}
+
+	// either side
+	uint8_t count(void) const { return (uint8_t)(_head - _tail); }
+	uint8_t space(void) const { return SIZE - count(); }
+	bool empty(void) const { return _head == _tail; }
+	bool full(void) const { return count() == SIZE; }
+
+	// writer: false, and c dropped, if the queue is full
+	bool put(uint8_t c)
+	{
+		uint8_t h = _head;
+
+		if ((uint8_t)(h - _tail) == SIZE)
+			return false;
+		_buf[h & MASK] = c;
+		_head = h + 1;
+		return true;
+	}
+
+	// reader: -1 if the queue is empty
+	int get(void)
+	{
+		uint8_t t = _tail;
+		uint8_t c;
+
+		if (_head == t)
+			return -1;
+		c = _buf[t & MASK];
+		_tail = t + 1;
+		return c;
+	}
+
+	// reader: the next byte get() will return, or -1
+	int peek(void) const
+	{
+		uint8_t t = _tail;
+
+		if (_head == t)
+			return -1;
+		return _buf[t & MASK];
+	}
+
+	// reader: throw away everything queued
+	void clear(void) { _tail = _head; }
+};
+
+#endif // ndef RingBuffer_h
@@ -0,0 +1,121 @@
+/*
+  Task.h - cooperative, stackless tasks in the style of protothreads
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General
+  Public License along with this library; if not, write to the
+  Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+  Boston, MA  02111-1307  USA
+
+  A task is a function that is called over and over by the scheduler.
+  The TASK_ macros below let it stop part way through and pick up
+  from the same spot on its next call, so it can be written as if it
+  blocked:
+
+    Task blinker;
+
+    char blink(Task *t)
+    {
+      TASK_BEGIN(t);
+      for (;;) {
+        digitalToggle(13);
+        TASK_SLEEP_FOR(t, 500);
+      }
+      TASK_END(t);
+    }
+
+    void setup() { taskStart(&blinker, blink); }
+
+  Build the core with -DUSE_TASKS=1 and main() runs the tasks instead
+  of loop(), putting the CPU into idle sleep whenever every task is
+  waiting.  Timer 0 wakes it at least every couple of milliseconds, so
+  a TASK_WAIT_UNTIL() on something no interrupt signals (a pin, say)
+  is still polled that often.
+
+  Before sleeping, the scheduler goes round the tasks once more with
+  interrupts off, so that one readied by an interrupt after it was
+  looked at isn't left until the next one.  On that round
+  TASK_WAIT_UNTIL() only tests its condition and returns, so a
+  condition may be tested more than once before the task goes on: it
+  must not have side effects, such as reading a byte.
+
+  There is no stack per task: local variables do not survive a
+  TASK_ macro, so keep state in statics or globals.  TASK_ macros only
+  work in the task function itself, not in functions it calls; they
+  can't be used inside a switch statement, and only one can go on
+  each line.  Each task costs 10 bytes.
+*/
+
+#ifndef Task_h
+#define Task_h
+
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+typedef struct task {
+	struct task *next;
+	char (*run)(struct task *);
+	unsigned long wake;         // millis() to wake at, in TASK_SLEEP_FOR
+	unsigned int lc;            // where to resume, 0 for the top
+} Task;
+
+// what a task function returns
+#define TASK_WAITING 0
+#define TASK_YIELDED 1
+#define TASK_ENDED 2
+
+#define TASK_BEGIN(t) switch ((t)->lc) { case 0:
+
+#define TASK_END(t) } (t)->lc = 0; return TASK_ENDED
+
+// Let the other tasks run, then carry on.
+#define TASK_YIELD(t) do {			\
+		(t)->lc = __LINE__; return TASK_YIELDED; \
+	case __LINE__: ;			\
+	} while (0)
+
+// Set while the scheduler is only asking whether any task is ready.
+extern uint8_t task_checking;
+
+// Wait, sleeping if everyone else is waiting too, until cond holds.
+#define TASK_WAIT_UNTIL(t, cond) do {		\
+		(t)->lc = __LINE__;		\
+	case __LINE__:				\
+		if (!(cond)) return TASK_WAITING; \
+		if (task_checking) return TASK_YIELDED; \
+	} while (0)
+
+#define TASK_SLEEP_FOR(t, ms) do {		\
+		(t)->wake = millis() + (ms);	\
+		TASK_WAIT_UNTIL(t, (long)(millis() - (t)->wake) >= 0); \
+	} while (0)
+
+// Finish the task from anywhere in its body.
+#define TASK_EXIT(t) do { (t)->lc = 0; return TASK_ENDED; } while (0)
+
+// Add t to the tasks that are run, starting fn from the top.  If t
+// is already running, it starts over.
+void taskStart(Task *t, char (*fn)(Task *));
+void taskStop(Task *t);
+
+// Run every task once; if they were all waiting, sleep until the
+// next interrupt.  Returns nonzero if any task got anything done.
+uint8_t taskRunAll(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,269 @@
+/*
+  UsiSerial.cpp - Half-duplex UART on the USI
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General
+  Public License along with this library; if not, write to the
+  Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+  Boston, MA  02111-1307  USA
+
+  After Atmel's AVR307.  Timer 0 runs in CTC mode at the bit rate and
+  clocks the USI in three-wire mode, which shifts one bit per compare
+  match and interrupts when its 4-bit counter overflows.
+
+  The USI shifts MSB first and the line wants LSB first, so bytes are
+  bit-reversed on the way in and out.  A frame going out is sent in two
+  loads of USIDR, as it is 10 bits and the register holds 8:
+
+    start d0 d1 d2 d3 | d4 d5 d6 d7 stop
+
+  the first overflowing the counter after 5 shifts, with d4 already on
+  DO, the second after 5 more at the end of the stop bit.  A frame
+  coming in starts with a pin change interrupt on the start bit's
+  falling edge, which starts timer 0 half a bit out of phase; the USI
+  then samples 9 times, mid start bit to mid d7, and the 8 bits left in
+  USIBR are the data.
+*/
+
+#include <inttypes.h>
+#include "wiring_private.h"
+
+#include "UsiSerial.h"
+#include "RingBuffer.h"
+
+#if USI_SERIAL
+
+#ifndef SERIAL_RX_BUFFER_SIZE
+#define SERIAL_RX_BUFFER_SIZE 16
+#endif
+
+#ifndef SERIAL_TX_BUFFER_SIZE
+#define SERIAL_TX_BUFFER_SIZE 16
+#endif
+
+#define RX_BIT _BV(PB0)		// DI
+#define TX_BIT _BV(PB1)		// DO
+
+// three-wire mode, clocked by timer 0 compare match, overflow interrupt
+#define USICR_RUN (_BV(USIOIE) | _BV(USIWM0) | _BV(USICS0))
+
+// Cycles from the start bit's falling edge to the write of TCNT0 in
+// the pin change handler: the pin synchronizer, the interrupt response
+// and the handler's prologue.
+#define RX_LATENCY_CYCLES 28
+
+#define USI_IDLE 0
+#define USI_RX 1
+#define USI_TX_FIRST 2		// start bit and d0-d3 going out
+#define USI_TX_SECOND 3		// d4-d7 and the stop bit going out
+
+static RingBuffer<SERIAL_RX_BUFFER_SIZE> rx_buffer;
+static RingBuffer<SERIAL_TX_BUFFER_SIZE> tx_buffer;
+
+static volatile uint8_t usi_state;
+static uint8_t tx_byte;		// reversed byte going out
+static uint8_t rx_start;	// TCNT0 for the first sample mid start bit
+
+static inline uint8_t reverse(uint8_t c)
+{
+	c = (c >> 4) | (c << 4);
+	c = ((c & 0xCC) >> 2) | ((c & 0x33) << 2);
+	c = ((c & 0xAA) >> 1) | ((c & 0x55) << 1);
+	return c;
+}
+
+// Watch RX for a start bit.  Edges seen while the USI was busy are
+// forgotten; they were the middle of some frame.
+static void rx_wait(void)
+{
+	usi_state = USI_IDLE;
+	GIFR = _BV(PCIF);
+	PCMSK |= RX_BIT;
+}
+
+// Start the next queued byte: the start bit goes out now, and the
+// first shift comes a bit later.
+static void tx_start(void)
+{
+	uint8_t c = reverse(tx_buffer.get());
+
+	PCMSK &= ~RX_BIT;
+	DDRB |= TX_BIT;
+
+	tx_byte = c;
+	usi_state = USI_TX_FIRST;
+	USIDR = c >> 1;
+	USISR = _BV(USIOIF) | (16 - 5);
+	GTCCR = _BV(PSR0);
+	TCNT0 = 0;
+	USICR = USICR_RUN;
+}
+
+// The USI counter overflowed.  Called with interrupts off.
+static void usi_overflow(void)
+{
+	switch (usi_state) {
+	case USI_RX:
+		rx_buffer.put(reverse(USIBR));
+		USICR = 0;
+		DDRB |= TX_BIT;
+		if (!tx_buffer.empty())
+			tx_start();
+		else
+			rx_wait();
+		break;
+
+	case USI_TX_FIRST:
+		// d4 is on DO already; this load keeps it there
+		USIDR = (tx_byte << 4) | 0x0F;
+		USISR = _BV(USIOIF) | (16 - 5);
+		usi_state = USI_TX_SECOND;
+		break;
+
+	case USI_TX_SECOND:
+		if (!tx_buffer.empty()) {
+			tx_start();
+		} else {
+			USICR = 0;
+			rx_wait();
+		}
+		break;
+	}
+}
+
+ISR(USI_OVF_vect)
+{
+	usi_overflow();
+}
+
+// A start bit, or any other edge on RX while we're idle.
+ISR(PCINT0_vect)
+{
+	if ((PINB & RX_BIT) || usi_state != USI_IDLE)
+		return;
+
+	TCNT0 = rx_start;
+	GTCCR = _BV(PSR0);
+
+	// Let TX go to the pull-up while the USI has DO: it would put the
+	// bits coming in out on TX.
+	DDRB &= ~TX_BIT;
+	PCMSK &= ~RX_BIT;
+	usi_state = USI_RX;
+	USISR = _BV(USIOIF) | (16 - 9);
+	USICR = USICR_RUN;
+}
+
+// Public Methods //////////////////////////////////////////////////////////////
+
+void UsiSerial::begin(long baud)
+{
+	unsigned long cycles = (F_CPU + baud / 2) / baud;
+	uint8_t cs, shift;
+	unsigned int ticks;
+
+	if (cycles <= 256) {
+		cs = _BV(CS00);
+		shift = 0;
+	} else if (cycles <= 256 * 8) {
+		cs = _BV(CS01);
+		shift = 3;
+	} else if (cycles <= 256 * 64) {
+		cs = _BV(CS01) | _BV(CS00);
+		shift = 6;
+	} else {
+		cs = _BV(CS02);
+		shift = 8;
+	}
+	ticks = (cycles + (1 << shift >> 1)) >> shift;
+
+	// the first sample lands half a bit after the edge
+	rx_start = ticks - ticks / 2 + (RX_LATENCY_CYCLES >> shift);
+	if (rx_start > ticks - 1)
+		rx_start = ticks - 1;
+
+	USICR = 0;
+	PORTB |= RX_BIT | TX_BIT;	// RX pulled up, TX idles high
+	DDRB &= ~RX_BIT;
+	DDRB |= TX_BIT;
+
+	TCCR0A = _BV(WGM01);
+	TCCR0B = cs;
+	OCR0A = ticks - 1;
+
+	GIMSK |= _BV(PCIE);
+	rx_wait();
+}
+
+void UsiSerial::end()
+{
+	flush();
+
+	PCMSK &= ~RX_BIT;
+	USICR = 0;
+	TCCR0B = 0;
+	usi_state = USI_IDLE;
+}
+
+int UsiSerial::available(void)
+{
+	return rx_buffer.count();
+}
+
+int UsiSerial::peek(void)
+{
+	return rx_buffer.peek();
+}
+
+int UsiSerial::read(void)
+{
+	return rx_buffer.get();
+}
+
+// Wait until everything written has gone, stop bit and all.
+void UsiSerial::flush()
+{
+	while (!tx_buffer.empty() || usi_state >= USI_TX_FIRST) {
+		// with interrupts off the overflows have to be handled here
+		if (!(SREG & _BV(SREG_I)) && (USISR & _BV(USIOIF)))
+			usi_overflow();
+	}
+}
+
+void UsiSerial::write(uint8_t c)
+{
+	uint8_t oldSREG;
+
+	// Queue full: wait for the interrupt to make room, or make room
+	// ourselves if interrupts are off and it never will.
+	while (!tx_buffer.put(c)) {
+		if (!(SREG & _BV(SREG_I)) && (USISR & _BV(USIOIF)))
+			usi_overflow();
+	}
+
+	oldSREG = SREG;
+	cli();
+	if (usi_state == USI_IDLE)
+		tx_start();
+	SREG = oldSREG;
+}
+
+int UsiSerial::availableForWrite(void)
+{
+	return tx_buffer.space();
+}
+
+// Preinstantiate Objects //////////////////////////////////////////////////////
+
+UsiSerial Serial;
+
+#endif
@@ -0,0 +1,57 @@
+/*
+  UsiSerial.h - Half-duplex UART on the USI
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General
+  Public License along with this library; if not, write to the
+  Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+  Boston, MA  02111-1307  USA
+*/
+
+#ifndef UsiSerial_h
+#define UsiSerial_h
+
+#include <inttypes.h>
+#include "wiring.h"
+#include "Stream.h"
+
+// 8N1 serial with RX on pin 0 (PB0, DI) and TX on pin 1 (PB1, DO),
+// built with -DUSI_SERIAL=1.  The USI shifts the bits in and out on
+// its own, clocked by timer 0 compare matches at the bit rate, so the
+// CPU sees a pin change interrupt per start bit and two USI overflow
+// interrupts per byte rather than one per bit.
+//
+// There is one shift register, so the line is half duplex: a byte
+// starts going out only when none is coming in, and a byte that
+// arrives while one is going out is lost.  While a byte comes in, TX
+// is held high by the pull-up only.
+//
+// 9600 to 57600 baud at 8 MHz, up to 115200 at 16 MHz.
+class UsiSerial : public Stream
+{
+public:
+	void begin(long);
+	void end();
+	virtual int available(void);
+	virtual int peek(void);
+	virtual int read(void);
+	virtual void flush(void);
+	virtual void write(uint8_t);
+	int availableForWrite(void);
+	using Print::write; // pull in write(str) and write(buf, size) from Print
+};
+
+#if USI_SERIAL
+extern UsiSerial Serial;
+#endif
+
+#endif
@@ -8,9 +8,11 @@
 #include <avr/interrupt.h>
 
 #include "wiring.h"
+#include "Task.h"
 
 #ifdef __cplusplus
-//#include "HardwareSerial.h" // burp
+#include "UsiSerial.h"
+#include "PinGroup.h"
 
 uint16_t makeWord(uint16_t w);
 uint16_t makeWord(byte h, byte l);
@@ -27,4 +29,6 @@ long map(long, long, long, long, long);
 
 #endif
 
+#include "wiring_fast.h"
+
 #endif
\ No newline at end of file
@@ -4,8 +4,16 @@ int main(void)
 
 	setup();
     
-	for (;;)
+	for (;;) {
+#if USE_TASKS
+		taskRunAll();
+#else
 		loop();
+#endif
+#if SOFT_TIMER_COUNT
+		softTimerDispatch();
+#endif
+	}
         
 	return 0;
 }
@@ -39,56 +39,19 @@
 //                  +----+
 
 
-#define PB 1
-
 #define REPEAT8(x) x, x, x, x, x, x, x, x
 #define BV0TO7 _BV(0), _BV(1), _BV(2), _BV(3), _BV(4), _BV(5), _BV(6), _BV(7)
 #define BV7TO0 _BV(7), _BV(6), _BV(5), _BV(4), _BV(3), _BV(2), _BV(1), _BV(0)
 
 
-// these arrays map port names (e.g. port B) to the
-// appropriate addresses for various functions (e.g. reading
-// and writing) tiny45 only port B 
-const uint8_t PROGMEM port_to_mode_PGM[] = {
-	NOT_A_PORT,
-	&DDRB,
-};
-
-const uint8_t PROGMEM port_to_output_PGM[] = {
-	NOT_A_PORT,
-	&PORTB,
-};
-
-const uint8_t PROGMEM port_to_input_PGM[] = {
-	NOT_A_PIN,
-	&PINB,
-};
-
-const uint8_t PROGMEM digital_pin_to_port_PGM[] = {
-	PB, /* 0 */
-	PB,
-	PB,
-	PB,
-	PB, 
-	PB, // 5
-
-};
-
-const uint8_t PROGMEM digital_pin_to_bit_mask_PGM[] = {
-	_BV(0), /* 0, port B */
-	_BV(1),
-	_BV(2),
-	_BV(3), /* 3 port B */
-	_BV(4),
-	_BV(5),
-
-};
-
-const uint8_t PROGMEM digital_pin_to_timer_PGM[] = {
-	TIMER0A, /* OC0A */
-	TIMER1,
-	NOT_ON_TIMER,
-	NOT_ON_TIMER,
-	NOT_ON_TIMER,
-	NOT_ON_TIMER,
+// One descriptor per pin; see PIN_DESC() in pins_arduino.h.  This
+// replaces the separate port, bit mask and timer tables and the
+// port-to-register tables, so a pin operation is one flash read.
+const uint16_t PROGMEM digital_pin_to_desc_PGM[] = {
+	PIN_DESC(PB, 0, TIMER0A), /* 0: OC0A */
+	PIN_DESC(PB, 1, TIMER1),  /* 1: OC1A */
+	PIN_DESC(PB, 2, NOT_ON_TIMER),
+	PIN_DESC(PB, 3, NOT_ON_TIMER),
+	PIN_DESC(PB, 4, NOT_ON_TIMER),
+	PIN_DESC(PB, 5, NOT_ON_TIMER),
 };
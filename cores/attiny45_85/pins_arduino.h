@@ -28,38 +28,67 @@
 #ifndef Pins_Arduino_h
 #define Pins_Arduino_h
 
+#include <avr/io.h>
 #include <avr/pgmspace.h>
 
 #define NOT_A_PIN 0
 #define NOT_A_PORT 0
 
+// Port numbers, as returned by digitalPinToPort(); only port B here.
+#define PB 1
+
+// One bit per timer channel, so a set of them fits in a byte (see
+// pwm_attached in wiring_digital.c).
 #define NOT_ON_TIMER 0
-#define TIMER0A 1
-#define TIMER0B 2
-#define TIMER1 3
+#define TIMER0A 0x01
+#define TIMER0B 0x02
+#define TIMER1 0x04
+
+// One word per pin in digital_pin_to_desc_PGM:
+//
+//   bits 0-7   bit mask within the port
+//   bits 8-11  timer channel (TIMER0A etc.), or NOT_ON_TIMER
+//   bits 12-15 port (always PB here)
+//
+// so a pin operation costs one pgm_read_word.
+#define PIN_DESC(port, bit, timer) ( _BV(bit) | ((timer) << 8) | ((port) << 12) )
 
-//changed it to uint16_t to uint8_t
-extern const uint8_t PROGMEM port_to_mode_PGM[];
-extern const uint8_t PROGMEM port_to_input_PGM[];
-extern const uint8_t PROGMEM port_to_output_PGM[];
+extern const uint16_t PROGMEM digital_pin_to_desc_PGM[];
 
-extern const uint8_t PROGMEM digital_pin_to_port_PGM[];
-// extern const uint8_t PROGMEM digital_pin_to_bit_PGM[];
-extern const uint8_t PROGMEM digital_pin_to_bit_mask_PGM[];
-extern const uint8_t PROGMEM digital_pin_to_timer_PGM[];
+#define digitalPinToDesc(P) ( pgm_read_word( digital_pin_to_desc_PGM + (P) ) )
+#define pinDescBitMask(D) ( (uint8_t)(D) )
+#define pinDescTimer(D) ( (uint8_t)((D) >> 8) & 0x0F )
+#define pinDescPort(D) ( (uint8_t)((D) >> 12) )
 
 // Get the bit location within the hardware port of the given virtual pin.
 // This comes from the pins_*.c file for the active board configuration.
 // 
 // These perform slightly better as macros compared to inline functions
 //
-#define digitalPinToPort(P) ( pgm_read_byte( digital_pin_to_port_PGM + (P) ) )
-#define digitalPinToBitMask(P) ( pgm_read_byte( digital_pin_to_bit_mask_PGM + (P) ) )
-#define digitalPinToTimer(P) ( pgm_read_byte( digital_pin_to_timer_PGM + (P) ) )
+#define digitalPinToPort(P) pinDescPort( digitalPinToDesc(P) )
+#define digitalPinToBitMask(P) pinDescBitMask( digitalPinToDesc(P) )
+#define digitalPinToTimer(P) pinDescTimer( digitalPinToDesc(P) )
 #define analogInPinToBit(P) (P)
-// in the following lines modified pgm_read_word in pgm_read_byte, word doesn't work on attiny45
-#define portOutputRegister(P) ( (volatile uint8_t *)( pgm_read_byte( port_to_output_PGM + (P))) )
-#define portInputRegister(P) ( (volatile uint8_t *)( pgm_read_byte( port_to_input_PGM + (P))) )
-#define portModeRegister(P) ( (volatile uint8_t *)( pgm_read_byte( port_to_mode_PGM + (P))) )
+// port B is the only port, so there is nothing to look up
+#define portOutputRegister(P) (&PORTB)
+#define portInputRegister(P) (&PINB)
+#define portModeRegister(P) (&DDRB)
+
+// Compile-time pin traits.  Same information as the table in
+// pins_arduino.c, written as arithmetic on the pin number so that a
+// constant pin folds down to a fixed register and bit.  Everything
+// lives on port B here, and pin N is PBN.
+#define NUM_DIGITAL_PINS 6
+
+#define digitalPinToBitConst(P) (P)
+#define digitalPinToOutputRegConst(P) (&PORTB)
+#define digitalPinToInputRegConst(P) (&PINB)
+#define digitalPinToModeRegConst(P) (&DDRB)
+#define portOutputRegConst(P) portOutputRegister(P)
+#define portInputRegConst(P) portInputRegister(P)
+#define portModeRegConst(P) portModeRegister(P)
+#define digitalPinToTimerConst(P) ( (P) == 0 ? TIMER0A : \
+				    (P) == 1 ? TIMER1 :  \
+				    NOT_ON_TIMER )
 
 #endif
@@ -27,131 +27,388 @@
 
 #include "wiring_private.h"
 
-// the prescaler is set so that timer0 ticks every 64 clock cycles, and the
-// the overflow handler is called every 256 ticks.
-#define MICROSECONDS_PER_TIMER0_OVERFLOW (clockCyclesToMicroseconds(64 * 256))
-
-// the whole number of milliseconds per timer0 overflow
-#define MILLIS_INC (MICROSECONDS_PER_TIMER0_OVERFLOW / 1000)
-
-// the fractional number of milliseconds per timer0 overflow. we shift right
-// by three to fit these numbers into a byte. (for the clock speeds we care
-// about - 8 and 16 MHz - this doesn't lose precision.)
-#define FRACT_INC ((MICROSECONDS_PER_TIMER0_OVERFLOW % 1000) >> 3)
-#define FRACT_MAX (1000 >> 3)
+// Timer 0 ticks every 64 clock cycles and overflows every 256 ticks.
+// The constants below are worked out from F_CPU as exact fractions, so
+// millis() and micros() don't drift at any clock that is a multiple of
+// 64 Hz: crystal clocks such as 14.7456 MHz included.
+#if F_CPU % 64
+#error "F_CPU must be a multiple of 64"
+#endif
+#define TIMER0_HZ (F_CPU / 64)
+
+// the largest powers of 2 and of 5 that divide TIMER0_HZ; the factors
+// it can share with a power of ten
+#define TIMER0_HZ_POW2 ((TIMER0_HZ) & -(TIMER0_HZ))
+#define TIMER0_HZ_POW5							\
+	(TIMER0_HZ % 15625 == 0 ? 15625L : TIMER0_HZ % 3125 == 0 ? 3125L : \
+	 TIMER0_HZ % 625 == 0 ? 625L : TIMER0_HZ % 125 == 0 ? 125L :	\
+	 TIMER0_HZ % 25 == 0 ? 25L : TIMER0_HZ % 5 == 0 ? 5L : 1L)
+
+// An overflow is 256000 / TIMER0_HZ ms (256000 = 2^11 * 5^3): MILLIS_INC
+// whole milliseconds and FRACT_INC / FRACT_MAX of one, in lowest terms.
+#define MILLIS_GCD (min(TIMER0_HZ_POW2, 2048L) * min(TIMER0_HZ_POW5, 125L))
+#define MILLIS_INC (256000L / TIMER0_HZ)
+#define FRACT_INC ((256000L % TIMER0_HZ) / MILLIS_GCD)
+#define FRACT_MAX (TIMER0_HZ / MILLIS_GCD)
+
+// millis() adds up to FRACT_MAX - 1 to a fraction that is already
+// below FRACT_MAX, so 2 * FRACT_MAX - 2 has to fit an unsigned int.
+#if FRACT_MAX > 32767
+#error "millis() can't keep exact time at this F_CPU"
+#endif
 
+// A tick is MICROS_NUM / MICROS_DEN us (1000000 = 2^6 * 5^6), in lowest
+// terms.  At 1, 8 and 16 MHz MICROS_DEN is 1 and micros() is just a
+// shift.
+#define MICROS_GCD (min(TIMER0_HZ_POW2, 64L) * min(TIMER0_HZ_POW5, 15625L))
+#define MICROS_NUM (1000000L / MICROS_GCD)
+#define MICROS_DEN (TIMER0_HZ / MICROS_GCD)
+
+// The overflow handler does nothing but count; millis() works out the
+// time from the count when it is asked.  timer0_millis and
+// timer0_fract are what the old handler would have accumulated by the
+// time timer0_overflow_count reached timer0_millis_count.
 volatile unsigned long timer0_overflow_count = 0;
-volatile unsigned long timer0_millis = 0;
-static unsigned char timer0_fract = 0;
+static unsigned long timer0_millis = 0;
+static unsigned int timer0_fract = 0;
+static unsigned long timer0_millis_count = 0;
+
+// Where MICROS_DEN isn't 1 micros() keeps a running total the same
+// way, as the tick count would wrap at 2^32 ticks, a few hours before
+// the microseconds do.  timer0_micros, plus timer0_micros_rem /
+// MICROS_DEN, was the time in microseconds when
+// timer0_overflow_count reached timer0_micros_count.  An overflow is
+// MICROS_OVF_US microseconds and MICROS_OVF_REM / MICROS_DEN.
+#if !MICROS_USE_TIMER1 && MICROS_DEN > 1
+#if MICROS_DEN > 65535
+#error "micros() can't keep exact time at this F_CPU"
+#endif
+#define MICROS_OVF_US (256 * MICROS_NUM / MICROS_DEN)
+#define MICROS_OVF_REM (256 * MICROS_NUM % MICROS_DEN)
+static unsigned long timer0_micros = 0;
+static unsigned int timer0_micros_rem = 0;
+static unsigned long timer0_micros_count = 0;
+#endif
 
-//different name, TIMER0_OVF_vect to this
-SIGNAL(TIM0_OVF_vect)
-{
-	// copy these to local variables so they can be stored in registers
-	// (volatile variables must be read from memory on every access)
-	unsigned long m = timer0_millis;
-	unsigned char f = timer0_fract;
-
-	m += MILLIS_INC;
-	f += FRACT_INC;
-	if (f >= FRACT_MAX) {
-		f -= FRACT_MAX;
-		m += 1;
+// Overflow handlers that just bump a 32-bit count.  They save only
+// r24 and SREG, in GPIOR1 and GPIOR2 instead of on the stack: 17
+// cycles with the reti, 6 more per carry.  Keep sketches off GPIOR1
+// and GPIOR2.
+#define OVERFLOW_COUNT_ISR(vect, count)				\
+	ISR(vect, ISR_NAKED)						\
+	{								\
+		asm volatile (						\
+			"out %[r24], r24"		"\n\t"		\
+			"in r24, __SREG__"		"\n\t"		\
+			"out %[sreg], r24"		"\n\t"		\
+			"lds r24, " #count		"\n\t"		\
+			"inc r24"			"\n\t"		\
+			"sts " #count ", r24"		"\n\t"		\
+			"brne 1f"			"\n\t"		\
+			"lds r24, " #count "+1"		"\n\t"		\
+			"inc r24"			"\n\t"		\
+			"sts " #count "+1, r24"		"\n\t"		\
+			"brne 1f"			"\n\t"		\
+			"lds r24, " #count "+2"		"\n\t"		\
+			"inc r24"			"\n\t"		\
+			"sts " #count "+2, r24"		"\n\t"		\
+			"brne 1f"			"\n\t"		\
+			"lds r24, " #count "+3"		"\n\t"		\
+			"inc r24"			"\n\t"		\
+			"sts " #count "+3, r24"		"\n\t"		\
+			"1: in r24, %[sreg]"		"\n\t"		\
+			"out __SREG__, r24"		"\n\t"		\
+			"in r24, %[r24]"		"\n\t"		\
+			"reti"							\
+			:: [r24] "I" (_SFR_IO_ADDR(GPIOR1)),		\
+			   [sreg] "I" (_SFR_IO_ADDR(GPIOR2))		\
+		);							\
 	}
 
-	timer0_fract = f;
-	timer0_millis = m;
+// With USI_SERIAL timer 0 is the UART's bit clock, and timer 1 keeps
+// time instead, at the same prescale of 64.  The timer0_ names stay.
+#if USI_SERIAL
+#if MICROS_USE_TIMER1
+#error "USI_SERIAL already has timer 1 running micros()"
+#endif
+#define TIMEBASE_OVF_vect TIM1_OVF_vect
+#define TIMEBASE_TCNT TCNT1
+#define TIMEBASE_TOV TOV1
+#else
+#define TIMEBASE_OVF_vect TIM0_OVF_vect
+#define TIMEBASE_TCNT TCNT0
+#define TIMEBASE_TOV TOV0
+#endif
+
+#if SOFT_TIMER_COUNT
+// the software timers need a proper C handler
+ISR(TIMEBASE_OVF_vect)
+{
 	timer0_overflow_count++;
+	softTimerTick();
 }
+#else
+OVERFLOW_COUNT_ISR(TIMEBASE_OVF_vect, timer0_overflow_count)
+#endif
+
+#if MICROS_USE_TIMER1
+// Timer 1 has a prescaler for every power of two, so it can be made to
+// tick exactly once a microsecond and micros() is just the overflow
+// count and TCNT1 side by side.
+#if F_CPU == 1000000L
+#define TIMER1_CS _BV(CS10)
+#elif F_CPU == 2000000L
+#define TIMER1_CS _BV(CS11)
+#elif F_CPU == 4000000L
+#define TIMER1_CS (_BV(CS11) | _BV(CS10))
+#elif F_CPU == 8000000L
+#define TIMER1_CS _BV(CS12)
+#elif F_CPU == 16000000L
+#define TIMER1_CS (_BV(CS12) | _BV(CS10))
+#else
+#error "MICROS_USE_TIMER1 needs F_CPU of 1, 2, 4, 8 or 16 MHz"
+#endif
+
+volatile unsigned long timer1_overflow_count = 0;
+
+OVERFLOW_COUNT_ISR(TIM1_OVF_vect, timer1_overflow_count)
+#endif
+
+// n overflows of the old handler in one step; exactly the same sums,
+// so millis() rolls over as it always did.
+#define TIMER0_ADVANCE(n) do {					\
+		m += (n) * MILLIS_INC + ((n) * FRACT_INC) / FRACT_MAX;	\
+		f += ((n) * FRACT_INC) % FRACT_MAX;			\
+		if (f >= FRACT_MAX) {					\
+			f -= FRACT_MAX;					\
+			m += 1;						\
+		}							\
+	} while (0)
 
 unsigned long millis()
 {
-	unsigned long m;
+	unsigned long m, c, n;
+	unsigned int f;
+	unsigned int n16;
+	uint8_t n8;
 	uint8_t oldSREG = SREG;
 
-	// disable interrupts while we read timer0_millis or we might get an
-	// inconsistent value (e.g. in the middle of a write to timer0_millis)
+	// disable interrupts while we read the count and the saved state,
+	// or we might get an inconsistent value
 	cli();
 	m = timer0_millis;
+	f = timer0_fract;
+	c = timer0_millis_count;
+	n = timer0_overflow_count - c;
+	SREG = oldSREG;
+
+	if (n == 0)
+		return m;
+	c += n;
+
+	// the big steps only run if nobody has asked in a while
+	while (n >= 65536) {
+		TIMER0_ADVANCE(65536UL);
+		n -= 65536;
+	}
+	n16 = n;
+	while (n16 >= 256) {
+		TIMER0_ADVANCE(256UL);
+		n16 -= 256;
+	}
+	n8 = n16;
+	while (n8--)
+		TIMER0_ADVANCE(1UL);
+
+	cli();
+	timer0_millis = m;
+	timer0_fract = f;
+	timer0_millis_count = c;
 	SREG = oldSREG;
 
 	return m;
 }
 
+#if MICROS_USE_TIMER1
 unsigned long micros() {
-	unsigned long m, t;
+	unsigned long m;
+	uint8_t t;
+	uint8_t oldSREG = SREG;
+
+	cli();
+	t = TCNT1;
+	m = timer1_overflow_count;
+
+	// a pending overflow came before our TCNT1 reading if the
+	// counter has only just started again
+	if ((TIFR & _BV(TOV1)) && (t < 128))
+		m++;
+	SREG = oldSREG;
+
+	return (m << 8) | t;
+}
+#elif MICROS_DEN == 1
+unsigned long micros() {
+	unsigned long m;
+	uint8_t t;
 	uint8_t oldSREG = SREG;
 	
 	cli();	
-	t = TCNT0;
-  
+	t = TIMEBASE_TCNT;
+	m = timer0_overflow_count;
+
+	// A pending overflow came before our TCNT0 reading if the counter
+	// has only just started again.  (Testing t == 0 alone missed it
+	// as soon as TCNT0 had moved on.)
 #ifdef TIFR0
-	if ((TIFR0 & _BV(TOV0)) && (t == 0))
-		t = 256;
+	if ((TIFR0 & _BV(TIMEBASE_TOV)) && (t < 128))
+		m++;
 #else
-	if ((TIFR & _BV(TOV0)) && (t == 0))
-		t = 256;
+	if ((TIFR & _BV(TIMEBASE_TOV)) && (t < 128))
+		m++;
 #endif
-
-	m = timer0_overflow_count;
 	SREG = oldSREG;
 	
-	return ((m << 8) + t) * (64 / clockCyclesPerMicrosecond());
+	return ((m << 8) + t) * MICROS_NUM;
 }
+#else
+unsigned long micros() {
+	unsigned long m, n, c;
+	unsigned long r;
+	uint8_t t, pending = 0;
+	uint8_t oldSREG = SREG;
+
+	cli();
+	t = TIMEBASE_TCNT;
+	n = timer0_overflow_count;
+	m = timer0_micros;
+	r = timer0_micros_rem;
+	c = timer0_micros_count;
+
+	// a pending overflow, as above; it is left out of the total, which
+	// only goes as far as the handler has counted
+#ifdef TIFR0
+	if ((TIFR0 & _BV(TIMEBASE_TOV)) && (t < 128))
+		pending = 1;
+#else
+	if ((TIFR & _BV(TIMEBASE_TOV)) && (t < 128))
+		pending = 1;
+#endif
+	SREG = oldSREG;
 
+	// n overflows are n / MICROS_DEN * 256 * MICROS_NUM microseconds
+	// exactly, and then what the other n % MICROS_DEN come to; that way
+	// round nothing overflows, and the total wraps at 2^32 as it should.
+	n -= c;
+	if (n) {
+		c += n;
+		m += n * MICROS_OVF_US + n / MICROS_DEN * MICROS_OVF_REM;
+		r += n % MICROS_DEN * MICROS_OVF_REM;
+		m += r / MICROS_DEN;
+		r %= MICROS_DEN;
+
+		cli();
+		timer0_micros = m;
+		timer0_micros_rem = r;
+		timer0_micros_count = c;
+		SREG = oldSREG;
+	}
+
+	if (pending) {
+		m += MICROS_OVF_US;
+		r += MICROS_OVF_REM;
+	}
+	return m + (r + t * MICROS_NUM) / MICROS_DEN;
+}
+#endif
+
+// Both of these sleep in idle mode between checks, so timers, USI and
+// pin interrupts keep going while the CPU waits.  Each check is made
+// with interrupts off, and sleepIdle() turns them on together with the
+// sleep, so a timer 0 tick can't come in between and leave us asleep
+// through it.  With interrupts off on entry they spin, as delay()
+// always did.
 void delay(unsigned long ms)
 {
+	uint8_t oldSREG = SREG;
 	unsigned long start = millis();
-	
-	while (millis() - start <= ms)
-		;
+
+	for (;;) {
+		cli();
+		if (millis() - start > ms)
+			break;
+		if (oldSREG & _BV(SREG_I))
+			sleepIdle();
+	}
+	SREG = oldSREG;
+}
+
+// Wait until millis() reaches when (at most 2^31 ms ahead).  Stepping
+// when by a fixed period runs a loop at that rate without drift.
+void delayUntil(unsigned long when)
+{
+	uint8_t oldSREG = SREG;
+
+	for (;;) {
+		cli();
+		if ((long)(millis() - when) >= 0)
+			break;
+		if (oldSREG & _BV(SREG_I))
+			sleepIdle();
+	}
+	SREG = oldSREG;
 }
 
-/* Delay for the given number of microseconds.  Assumes a 8 or 16 MHz clock. 
- * Disables interrupts, which will disrupt the millis() function if used
- * too frequently. */
+/* Delay for the given number of microseconds.  Tuned to the cycle for
+ * 1, 8 and 16 MHz; any other clock takes a scaled path that comes out
+ * a few microseconds long on short delays.  Delays up to
+ * DELAY_US_CLI_MAX run with interrupts off, so nothing can stretch
+ * them; longer ones leave interrupts on and watch micros(), so they
+ * are only as exact as its resolution.  wiring_fast.h expands a
+ * constant delay inline, and only sends it here if it is one of the
+ * long ones. */
 void delayMicroseconds(unsigned int us)
 {
 	uint8_t oldSREG;
 
-	// calling avrlib's delay_us() function with low values (e.g. 1 or
-	// 2 microseconds) gives delays longer than desired.
-	//delay_us(us);
-
-#if F_CPU >= 16000000L
-	// for the 16 MHz clock on most Arduino boards
+#if DELAY_US_CLI_MAX < 65535
+	if (us > DELAY_US_CLI_MAX) {
+		unsigned long start = micros();
 
-	// for a one-microsecond delay, simply return.  the overhead
-	// of the function call yields a delay of approximately 1 1/8 us.
-	if (--us == 0)
+		while (micros() - start < us)
+			;
 		return;
+	}
+#endif
 
-	// the following loop takes a quarter of a microsecond (4 cycles)
-	// per iteration, so execute it four times for each microsecond of
-	// delay requested.
-	us <<= 2;
-
-	// account for the time taken in the preceeding commands.
-	us -= 2;
-#else
-	// for the 8 MHz internal clock on the ATmega168
+	// Each count below is for the 4-cycle loop at the end, less what the
+	// call, the test above, the arithmetic and the SREG handling cost.
 
-	// for a one- or two-microsecond delay, simply return.  the overhead of
-	// the function calls takes more than two microseconds.  can't just
-	// subtract two, since us is unsigned; we'd overflow.
-	if (--us == 0)
+#if F_CPU == 16000000L
+	// 4 loops per microsecond; about 24 cycles of overhead
+	if (us <= 1)
 		return;
-	if (--us == 0)
+	us <<= 2;
+	us -= 6;
+#elif F_CPU == 8000000L
+	// 2 loops per microsecond; about 22 cycles of overhead
+	if (us <= 3)
 		return;
-
-	// the following loop takes half of a microsecond (4 cycles)
-	// per iteration, so execute it twice for each microsecond of
-	// delay requested.
 	us <<= 1;
-    
-	// partially compensate for the time taken by the preceeding commands.
-	// we can't subtract any more than this or we'd overflow w/ small delays.
-	us--;
+	us -= 5;
+#elif F_CPU == 1000000L
+	// a loop is 4 microseconds; the overhead alone is about 24
+	if (us <= 28)
+		return;
+	us = (us - 24) >> 2;
+#else
+	// F_CPU / 4 MHz loops per microsecond in 8.8 fixed point.  The
+	// multiply is a library call on these parts (no MUL instruction),
+	// which is what makes short delays come out long.
+	us = ((unsigned long) us * (F_CPU / 15625L)) >> 8;
+	if (us <= 25)
+		return;
+	us -= 25;
 #endif
 
 	// disable interrupts, otherwise the timer 0 overflow interrupt that
@@ -171,11 +428,22 @@ void delayMicroseconds(unsigned int us)
 
 void init()
 {
+#if F_CPU == 16000000L
+	// 16 MHz comes from the PLL (or a crystal) with the system clock
+	// prescaler at 1.  The CKDIV8 fuse, set on new parts, starts it at
+	// 8; undo that here so the board only needs its clock source fuses
+	// changed.  The two writes must be 4 cycles apart, which they are
+	// with interrupts still off from reset.
+	CLKPR = _BV(CLKPCE);
+	CLKPR = 0;
+#endif
+
 	// this needs to be called before setup() or some functions won't
 	// work there
 	sei();
 	
 /* dumpt everything, and only added the 2 timers the attiny has */
+#if !USI_SERIAL
 	// on the ATmega168, timer 0 is also used for fast hardware pwm
 	// (using phase-correct PWM would mean that timer 0 overflowed half as often
 	// resulting in different millis() behavior on the ATmega8 and ATmega168)
@@ -187,7 +455,18 @@ void init()
 	sbi(TCCR0B, CS00);
 	// enable timer 0 overflow interrupt
 	sbi(TIMSK, TOIE0);
+#endif
 
+#if MICROS_USE_TIMER1
+	// timer 1 belongs to micros(): no PWM, free running
+	TCCR1 = TIMER1_CS;
+	sbi(TIMSK, TOIE1);
+#elif USI_SERIAL
+	// timer 1 keeps time in place of timer 0, which Serial.begin()
+	// sets up: normal mode, prescale factor 64
+	TCCR1 = _BV(CS12) | _BV(CS11) | _BV(CS10);
+	sbi(TIMSK, TOIE1);
+#else
 	// timers 1 are used for phase-correct hardware pwm
 	// this is better for motors as it ensures an even waveform
 	// note, however, that fast pwm mode can achieve a frequency of up
@@ -198,19 +477,23 @@ void init()
 	sbi(TCCR1, PWM1A);
 	// put timer 1 in 8-bit phase correct pwm mode
 	// sbi(TCCR1, WGM10); non c'è nell attiny 45
+#endif
 
-	// set a2d prescale factor to 128
-	// 16 MHz / 128 = 125 KHz, inside the desired 50-200 KHz range.
-	// XXX: this will not work properly for other clock speeds, and
-	// this code should use F_CPU to determine the prescale factor.
-/* added F_CPU prescaler */
-#if F_CPU >= 16000000L //128
+	// set the a2d prescale factor from F_CPU so the ADC clock lands
+	// in the 50-200 KHz range it wants for full resolution: 125 KHz at
+	// 1, 8 and 16 MHz.
+#if F_CPU > 12800000L		//128
 	sbi(ADCSRA, ADPS2);
 	sbi(ADCSRA, ADPS1);
 	sbi(ADCSRA, ADPS0);
-#elif F_CPU >= 8000000L //64
+#elif F_CPU > 6400000L		//64
 	sbi(ADCSRA, ADPS2);
 	sbi(ADCSRA, ADPS1);
+#elif F_CPU > 3200000L		//32
+	sbi(ADCSRA, ADPS2);
+	sbi(ADCSRA, ADPS0);
+#elif F_CPU > 1600000L		//16
+	sbi(ADCSRA, ADPS2);
 #else				//8
 	sbi(ADCSRA, ADPS1);
 	sbi(ADCSRA, ADPS0);
@@ -92,6 +92,55 @@ extern "C"{
 #define clockCyclesToMicroseconds(a) ( (a) / clockCyclesPerMicrosecond() )
 #define microsecondsToClockCycles(a) ( (a) * clockCyclesPerMicrosecond() )
 
+// Build with -DMICROS_USE_TIMER1=1 to hand timer 1 to micros(): it
+// then counts whole microseconds instead of 8 us (at 8 MHz) steps.
+// The cost is that timer 1 is only 8 bits: at a tick a microsecond it
+// overflows every 256 us, 3906 interrupts a second of 20-odd cycles
+// each.  That is about 1% of the CPU at 8 MHz, and 9% at 1 MHz.
+// analogWrite() on pin 1 falls back to digitalWrite().
+#ifndef MICROS_USE_TIMER1
+#define MICROS_USE_TIMER1 0
+#endif
+
+// Build with -DUSI_SERIAL=1 for Serial, a UART made from the USI with
+// RX on pin 0 and TX on pin 1 (see UsiSerial.h).  It needs timer 0 for
+// its bit clock, so millis() and micros() move to timer 1 (same rate,
+// same resolution) and analogWrite() has no PWM pins left.
+#ifndef USI_SERIAL
+#define USI_SERIAL 0
+#endif
+
+// Number of software timers (see wiring_timer.c).  With none, the
+// timer 0 overflow handler stays a bare counter.
+#ifndef SOFT_TIMER_COUNT
+#define SOFT_TIMER_COUNT 0
+#endif
+
+// Build with -DUSE_TASKS=1 to have main() run the tasks of Task.h
+// instead of calling loop().
+#ifndef USE_TASKS
+#define USE_TASKS 0
+#endif
+
+// delayMicroseconds() keeps interrupts off for delays up to this many
+// us, so they come out exact.  By default that's every delay, as it
+// always was.  Build with a smaller figure, such as
+// -DDELAY_US_CLI_MAX=500, to have longer delays leave interrupts on,
+// so millis() keeps up; they then time themselves with micros() and
+// are only good to its 8 us steps (64 us at 1 MHz).
+#ifndef DELAY_US_CLI_MAX
+#define DELAY_US_CLI_MAX 65535
+#endif
+
+// softTimerStart() flags
+#define SOFT_TIMER_ONESHOT 0x00
+#define SOFT_TIMER_PERIODIC 0x01
+#define SOFT_TIMER_DEFERRED 0x02  // call back from softTimerDispatch()
+
+// ticks (timer 0 overflows) in ms milliseconds, rounded up; free when
+// ms is a constant
+#define softTimerMs(ms) ( (unsigned int)(((ms) * (F_CPU / 1000UL) + 64UL * 256 - 1) / (64UL * 256)) )
+
 #define lowByte(w) ((uint8_t) ((w) & 0xff))
 #define highByte(w) ((uint8_t) ((w) >> 8))
 
@@ -111,6 +160,8 @@ void init(void);
 
 void pinMode(uint8_t, uint8_t);
 void digitalWrite(uint8_t, uint8_t);
+void digitalWriteAtomic(uint8_t, uint8_t);
+void digitalToggle(uint8_t);
 int digitalRead(uint8_t);
 int analogRead(uint8_t);
 void analogReference(uint8_t mode);
@@ -126,11 +177,17 @@ void analogWrite(uint8_t, int);
 unsigned long millis(void);
 unsigned long micros(void);
 void delay(unsigned long);
+void delayUntil(unsigned long);
 void delayMicroseconds(unsigned int us);
 unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout);
 
 void shiftOut(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, byte val);
 
+void softTimerStart(uint8_t id, unsigned int ticks, uint8_t flags, void (*)(void));
+void softTimerStop(uint8_t id);
+uint8_t softTimerActive(uint8_t id);
+void softTimerDispatch(void);
+
 void attachInterrupt(uint8_t, void (*)(void), int mode);
 void detachInterrupt(uint8_t);
 
@@ -80,29 +80,41 @@ void analogWrite(uint8_t pin, int val)
   // writing with them.  Also, make sure the pin is in output mode
   // for consistenty with Wiring, which doesn't require a pinMode
   // call for the analog output pins.
+  if (pin >= NUM_DIGITAL_PINS) return;
+
   pinMode(pin, OUTPUT);
 
+  uint8_t timer = digitalPinToTimer(pin);
+
   //Yep, only 2 PMW, Saposoft
   	
-if (digitalPinToTimer(pin) == TIMER0A) {
+#if !USI_SERIAL
+if (timer == TIMER0A) {
     if (val == 0) {
 	  digitalWrite(pin, LOW);
     } else {
 	  // connect pwm to pin on timer 0, channel A
 	  sbi(TCCR0A, COM0A1);
+	  pwm_attached |= TIMER0A;
 	  // set pwm duty
 	  OCR0A = val;      
     }
-  } else if (digitalPinToTimer(pin) == TIMER1) {
+  } else
+#endif
+#if !TIMER1_FREE_RUNNING
+  if (timer == TIMER1) {
     if (val == 0) {
 	  digitalWrite(pin, LOW);
     } else {
 	  // connect pwm to pin on timer 0, channel B
 	  sbi(TCCR1, COM1A1);
+	  pwm_attached |= TIMER1;
 	  // set pwm duty
 	  OCR1A = val;
     }
-  }  else if (val < 128)
+  } else
+#endif
+  if (val < 128)
     digitalWrite(pin, LOW);
   else
     digitalWrite(pin, HIGH);
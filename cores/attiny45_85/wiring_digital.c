@@ -30,30 +30,36 @@
 
 void pinMode(uint8_t pin, uint8_t mode)
 {
-	uint8_t bit = digitalPinToBitMask(pin);
-	uint8_t port = digitalPinToPort(pin);
+	uint16_t desc;
+	uint8_t bit;
 	volatile uint8_t *reg;
 
-	if (port == NOT_A_PIN) return;
+	if (pin >= NUM_DIGITAL_PINS) return;
 
-	// JWS: can I let the optimizer do this?
-	reg = portModeRegister(port);
+	desc = digitalPinToDesc(pin);
+	bit = pinDescBitMask(desc);
+	reg = portModeRegister(pinDescPort(desc));
 
 	if (mode == INPUT) *reg &= ~bit;
 	else *reg |= bit;
 }
 
+uint8_t pwm_attached = 0;
+
 // Forcing this inline keeps the callers from having to push their own stuff
 // on the stack. It is a good performance win and only takes 1 more byte per
 // user than calling. (It will take more bytes on the 168.)
 //
-// But shouldn't this be moved into pinMode? Seems silly to check and do on
-// each digitalread or write.
+// NOT_ON_TIMER is 0, so plain pins and timer pins without PWM running
+// both drop out at the first test.
 //
 //Only 2 PWM's
 static inline void turnOffPWM(uint8_t timer) __attribute__ ((always_inline));
 static inline void turnOffPWM(uint8_t timer)
 {
+	if (!(pwm_attached & timer)) return;
+	pwm_attached &= ~timer;
+
 	if (timer == TIMER1) cbi(TCCR1, COM1A1);
 	if (timer == TIMER1) cbi(TCCR1, COM1B1);
 	if (timer == TIMER0A) cbi(TCCR0A, COM0A1);
@@ -64,16 +70,20 @@ static inline void turnOffPWM(uint8_t timer)
 
 void digitalWrite(uint8_t pin, uint8_t val)
 {
-	uint8_t timer = digitalPinToTimer(pin);
-	uint8_t bit = digitalPinToBitMask(pin);
-	uint8_t port = digitalPinToPort(pin);
+	uint16_t desc;
+	uint8_t timer, bit, port;
 	volatile uint8_t *out;
 
-	if (port == NOT_A_PIN) return;
+	if (pin >= NUM_DIGITAL_PINS) return;
+
+	desc = digitalPinToDesc(pin);
+	timer = pinDescTimer(desc);
+	bit = pinDescBitMask(desc);
+	port = pinDescPort(desc);
 
-	// If the pin that support PWM output, we need to turn it off
+	// If the pin has PWM output running, we need to turn it off
 	// before doing a digital write.
-	if (timer != NOT_ON_TIMER) turnOffPWM(timer);
+	turnOffPWM(timer);
 
 	out = portOutputRegister(port);
 
@@ -81,17 +91,62 @@ void digitalWrite(uint8_t pin, uint8_t val)
 	else *out |= bit;
 }
 
+// digitalWrite() without the read-modify-write of PORTB: if the pin
+// isn't already at the requested level, write its bit to PINB, which
+// toggles it in hardware.  An interrupt handler writing other pins of
+// the port can't be undone by this, and no cli() is needed.
+void digitalWriteAtomic(uint8_t pin, uint8_t val)
+{
+	uint16_t desc;
+	uint8_t timer, bit, port;
+
+	if (pin >= NUM_DIGITAL_PINS) return;
+
+	desc = digitalPinToDesc(pin);
+	timer = pinDescTimer(desc);
+	bit = pinDescBitMask(desc);
+	port = pinDescPort(desc);
+
+	turnOffPWM(timer);
+
+	if (!(*portOutputRegister(port) & bit) != (val == LOW))
+		*portInputRegister(port) = bit;
+}
+
+// A 1 written to PINB toggles that PORTB bit: one store, nothing for
+// an interrupt to get in between.
+void digitalToggle(uint8_t pin)
+{
+	uint16_t desc;
+	uint8_t timer, bit, port;
+
+	if (pin >= NUM_DIGITAL_PINS) return;
+
+	desc = digitalPinToDesc(pin);
+	timer = pinDescTimer(desc);
+	bit = pinDescBitMask(desc);
+	port = pinDescPort(desc);
+
+	turnOffPWM(timer);
+
+	*portInputRegister(port) = bit;
+}
+
 int digitalRead(uint8_t pin)
 {
-	uint8_t timer = digitalPinToTimer(pin);
-	uint8_t bit = digitalPinToBitMask(pin);
-	uint8_t port = digitalPinToPort(pin);
+	uint16_t desc;
+	uint8_t timer, bit, port;
+
+	if (pin >= NUM_DIGITAL_PINS) return LOW;
 
-	if (port == NOT_A_PIN) return LOW;
+	desc = digitalPinToDesc(pin);
+	timer = pinDescTimer(desc);
+	bit = pinDescBitMask(desc);
+	port = pinDescPort(desc);
 
-	// If the pin that support PWM output, we need to turn it off
+	// If the pin has PWM output running, we need to turn it off
 	// before getting a digital reading.
-	if (timer != NOT_ON_TIMER) turnOffPWM(timer);
+	turnOffPWM(timer);
 
 	if (*portInputRegister(port) & bit) return HIGH;
 	return LOW;
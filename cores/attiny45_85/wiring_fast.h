@@ -0,0 +1,245 @@
+/*
+  wiring_fast.h - Constant-pin fast paths for the Wiring digital API
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General
+  Public License along with this library; if not, write to the
+  Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+  Boston, MA  02111-1307  USA
+*/
+
+#ifndef Wiring_Fast_h
+#define Wiring_Fast_h
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include "wiring.h"
+#include "pins_arduino.h"
+
+// When the pin number is a compile-time constant, pinMode(),
+// digitalWrite(), digitalWriteAtomic(), digitalToggle() and
+// digitalRead() turn into inline code on PORTB, DDRB and PINB: a
+// single sbi/cbi or sbis for the plain pins instead of the call
+// through the PROGMEM tables.  PB0 and PB1 still have their PWM output
+// switched off first, if analogWrite() left it on.  Runtime pin
+// numbers fall through to wiring_digital.c unchanged.
+//
+// Only WProgram.h includes this, so the core itself sees the plain
+// functions.
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+extern uint8_t pwm_attached;
+
+static inline void turnOffPWMConst(uint8_t timer) __attribute__ ((always_inline));
+static inline void turnOffPWMConst(uint8_t timer)
+{
+	if (!(pwm_attached & timer)) return;
+	pwm_attached &= ~timer;
+
+	if (timer == TIMER1) TCCR1 &= ~_BV(COM1A1);
+	if (timer == TIMER0A) TCCR0A &= ~(_BV(COM0A1) | _BV(COM0A0));
+	if (timer == TIMER0B) TCCR0A &= ~(_BV(COM0B1) | _BV(COM0B0));
+}
+
+static inline void pinModeConst(uint8_t pin, uint8_t mode) __attribute__ ((always_inline));
+static inline void pinModeConst(uint8_t pin, uint8_t mode)
+{
+	if (mode == INPUT) *digitalPinToModeRegConst(pin) &= ~_BV(digitalPinToBitConst(pin));
+	else *digitalPinToModeRegConst(pin) |= _BV(digitalPinToBitConst(pin));
+}
+
+static inline void digitalWriteConst(uint8_t pin, uint8_t val) __attribute__ ((always_inline));
+static inline void digitalWriteConst(uint8_t pin, uint8_t val)
+{
+	turnOffPWMConst(digitalPinToTimerConst(pin));
+
+	if (val == LOW) *digitalPinToOutputRegConst(pin) &= ~_BV(digitalPinToBitConst(pin));
+	else *digitalPinToOutputRegConst(pin) |= _BV(digitalPinToBitConst(pin));
+}
+
+// sbi/cbi is a single instruction, so the constant-pin digitalWrite()
+// is interrupt-safe already.
+#define digitalWriteAtomicConst(P, V) digitalWriteConst((P), (V))
+
+static inline void digitalToggleConst(uint8_t pin) __attribute__ ((always_inline));
+static inline void digitalToggleConst(uint8_t pin)
+{
+	turnOffPWMConst(digitalPinToTimerConst(pin));
+
+	*digitalPinToInputRegConst(pin) = _BV(digitalPinToBitConst(pin));
+}
+
+static inline int digitalReadConst(uint8_t pin) __attribute__ ((always_inline));
+static inline int digitalReadConst(uint8_t pin)
+{
+	turnOffPWMConst(digitalPinToTimerConst(pin));
+
+	if (*digitalPinToInputRegConst(pin) & _BV(digitalPinToBitConst(pin))) return HIGH;
+	return LOW;
+}
+
+// Whole-port access.  `port' is PB, the only port on these parts;
+// `mask' selects bits within it.  Each call ends in a single write to
+// the port register.  The read-modify-write cases run with interrupts
+// off unless port and mask are constant and name a single bit, in
+// which case the compiler emits an (atomic) sbi/cbi.  Toggling writes
+// the mask to PINB, which the hardware turns into a toggle of exactly
+// those bits.
+
+#define portMaskIsConstBit(P, M) \
+	( __builtin_constant_p(P) && __builtin_constant_p(M) && !((M) & ((M) - 1)) )
+
+static inline void portWrite(uint8_t port, uint8_t val) __attribute__ ((always_inline));
+static inline void portWrite(uint8_t port, uint8_t val)
+{
+	*portOutputRegConst(port) = val;
+}
+
+static inline uint8_t portRead(uint8_t port) __attribute__ ((always_inline));
+static inline uint8_t portRead(uint8_t port)
+{
+	return *portInputRegConst(port);
+}
+
+static inline void portSetMask(uint8_t port, uint8_t mask) __attribute__ ((always_inline));
+static inline void portSetMask(uint8_t port, uint8_t mask)
+{
+	uint8_t oldSREG;
+
+	if (portMaskIsConstBit(port, mask)) {
+		*portOutputRegConst(port) |= mask;
+		return;
+	}
+
+	oldSREG = SREG;
+	cli();
+	*portOutputRegConst(port) |= mask;
+	SREG = oldSREG;
+}
+
+static inline void portClearMask(uint8_t port, uint8_t mask) __attribute__ ((always_inline));
+static inline void portClearMask(uint8_t port, uint8_t mask)
+{
+	uint8_t oldSREG;
+
+	if (portMaskIsConstBit(port, mask)) {
+		*portOutputRegConst(port) &= ~mask;
+		return;
+	}
+
+	oldSREG = SREG;
+	cli();
+	*portOutputRegConst(port) &= ~mask;
+	SREG = oldSREG;
+}
+
+static inline void portToggleMask(uint8_t port, uint8_t mask) __attribute__ ((always_inline));
+static inline void portToggleMask(uint8_t port, uint8_t mask)
+{
+	*portInputRegConst(port) = mask;
+}
+
+// Set the bits in mask to the matching bits of val, leaving the rest
+// of the port alone.
+static inline void portWriteMask(uint8_t port, uint8_t mask, uint8_t val) __attribute__ ((always_inline));
+static inline void portWriteMask(uint8_t port, uint8_t mask, uint8_t val)
+{
+	uint8_t oldSREG = SREG;
+	cli();
+	*portOutputRegConst(port) = (*portOutputRegConst(port) & ~mask) | (val & mask);
+	SREG = oldSREG;
+}
+
+// pinMode() for every bit in mask at once.
+static inline void portModeMask(uint8_t port, uint8_t mask, uint8_t mode) __attribute__ ((always_inline));
+static inline void portModeMask(uint8_t port, uint8_t mask, uint8_t mode)
+{
+	uint8_t oldSREG = SREG;
+	cli();
+	if (mode == INPUT) *portModeRegConst(port) &= ~mask;
+	else *portModeRegConst(port) |= mask;
+	SREG = oldSREG;
+}
+
+// delayMicroseconds() with a constant argument, burnt inline with
+// interrupts off like the runtime version.  __builtin_avr_delay_cycles
+// makes it exact to the cycle, the SREG save, cli and restore (three
+// cycles) included; without it _delay_us() is within a few cycles.
+#define delayMicrosecondsCycles(us) ((unsigned long)(us) * (F_CPU / 1000UL) / 1000UL)
+
+static inline void delayMicrosecondsConst(unsigned int us) __attribute__ ((always_inline));
+static inline void delayMicrosecondsConst(unsigned int us)
+{
+	uint8_t oldSREG;
+
+	if (us == 0) return;
+
+#if DELAY_US_CLI_MAX < 65535
+	if (us > DELAY_US_CLI_MAX) {
+		delayMicroseconds(us);
+		return;
+	}
+#endif
+
+#if defined(__HAS_DELAY_CYCLES) && __HAS_DELAY_CYCLES
+	if (delayMicrosecondsCycles(us) <= 3) {
+		__builtin_avr_delay_cycles(delayMicrosecondsCycles(us));
+		return;
+	}
+
+	oldSREG = SREG;
+	cli();
+	__builtin_avr_delay_cycles(delayMicrosecondsCycles(us) - 3);
+	SREG = oldSREG;
+#else
+	oldSREG = SREG;
+	cli();
+	_delay_us(us);
+	SREG = oldSREG;
+#endif
+}
+
+// A macro isn't expanded inside its own expansion, so the fallback
+// arm below is a real call to the function of the same name.
+#define pinMode(P, M) \
+	( __builtin_constant_p(P) && (P) < NUM_DIGITAL_PINS ? \
+	  pinModeConst((P), (M)) : pinMode((P), (M)) )
+
+#define digitalWrite(P, V) \
+	( __builtin_constant_p(P) && (P) < NUM_DIGITAL_PINS ? \
+	  digitalWriteConst((P), (V)) : digitalWrite((P), (V)) )
+
+#define digitalWriteAtomic(P, V) \
+	( __builtin_constant_p(P) && (P) < NUM_DIGITAL_PINS ? \
+	  digitalWriteAtomicConst((P), (V)) : digitalWriteAtomic((P), (V)) )
+
+#define digitalToggle(P) \
+	( __builtin_constant_p(P) && (P) < NUM_DIGITAL_PINS ? \
+	  digitalToggleConst(P) : digitalToggle(P) )
+
+#define digitalRead(P) \
+	( __builtin_constant_p(P) && (P) < NUM_DIGITAL_PINS ? \
+	  digitalReadConst(P) : digitalRead(P) )
+
+#define delayMicroseconds(US) \
+	( __builtin_constant_p(US) ? \
+	  delayMicrosecondsConst(US) : delayMicroseconds(US) )
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -30,6 +30,7 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <avr/delay.h>
+#include <avr/sleep.h>
 #include <stdio.h>
 #include <stdarg.h>
 
@@ -53,6 +54,37 @@ extern "C"{
 
 typedef void (*voidFuncPtr)(void);
 
+// Timer channels (TIMER0A etc.) that analogWrite() has connected to
+// their pins; digitalWrite() and digitalRead() leave the others alone.
+extern uint8_t pwm_attached;
+
+// Timer 1 runs free for micros() or the timebase rather than doing
+// PWM.
+#define TIMER1_FREE_RUNNING (MICROS_USE_TIMER1 || USI_SERIAL)
+
+// Advance the software timers; called every timer 0 overflow.
+void softTimerTick(void);
+
+// Sleep in idle mode until the next interrupt.  Interrupts are turned
+// on here: call with them off after the last check for work, and an
+// interrupt in between still wakes us, since sei and sleep can't be
+// split.  Whatever sleep mode the sketch had chosen is restored.
+static inline void sleepIdle(void) __attribute__ ((always_inline));
+static inline void sleepIdle(void)
+{
+	uint8_t mode = MCUCR & (_BV(SM1) | _BV(SM0));
+
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	sleep_enable();
+	sei();
+	sleep_cpu();
+	// sleep_disable() and the mode put back in one write, which no
+	// handler may come between
+	cli();
+	MCUCR = (MCUCR & ~(_BV(SE) | _BV(SM1) | _BV(SM0))) | mode;
+	sei();
+}
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
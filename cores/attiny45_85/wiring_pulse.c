@@ -34,8 +34,9 @@ unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout)
 	// cache the port and bit of the pin in order to speed up the
 	// pulse width measuring loop and achieve finer resolution.  calling
 	// digitalRead() instead yields much coarser resolution.
-	uint8_t bit = digitalPinToBitMask(pin);
-	uint8_t port = digitalPinToPort(pin);
+	uint16_t desc = digitalPinToDesc(pin);
+	uint8_t bit = pinDescBitMask(desc);
+	volatile uint8_t *in = portInputRegister(pinDescPort(desc));
 	uint8_t stateMask = (state ? bit : 0);
 	unsigned long width = 0; // keep initialization out of time critical area
 	
@@ -45,17 +46,17 @@ unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout)
 	unsigned long maxloops = microsecondsToClockCycles(timeout) / 16;
 	
 	// wait for any previous pulse to end
-	while ((*portInputRegister(port) & bit) == stateMask)
+	while ((*in & bit) == stateMask)
 		if (numloops++ == maxloops)
 			return 0;
 	
 	// wait for the pulse to start
-	while ((*portInputRegister(port) & bit) != stateMask)
+	while ((*in & bit) != stateMask)
 		if (numloops++ == maxloops)
 			return 0;
 	
 	// wait for the pulse to stop
-	while ((*portInputRegister(port) & bit) == stateMask)
+	while ((*in & bit) == stateMask)
 		width++;
 
 	// convert the reading to microseconds. The loop has been determined
@@ -0,0 +1,212 @@
+/*
+  wiring_timer.c - software timers run off the timer 0 overflow tick
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General
+  Public License along with this library; if not, write to the
+  Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+  Boston, MA  02111-1307  USA
+
+  Build with -DSOFT_TIMER_COUNT=n (at most 8) to get n timers,
+  numbered 0 to n-1.  A timer counts timer 0 overflows ("ticks", see
+  softTimerMs()) and then calls its callback, either from the overflow
+  interrupt or, with SOFT_TIMER_DEFERRED, from the main loop via
+  softTimerDispatch().  Timers sit on a hashed wheel, so starting and
+  stopping one is a constant-time list operation and a tick only
+  looks at one slot's worth of timers.
+
+  RAM: 10 bytes per timer, 1 per wheel slot, and 2 more.
+*/
+
+#include "wiring_private.h"
+
+#if SOFT_TIMER_COUNT
+
+#if SOFT_TIMER_COUNT > 8
+#error "SOFT_TIMER_COUNT can be at most 8"
+#endif
+
+#ifndef SOFT_TIMER_WHEEL_SLOTS
+#define SOFT_TIMER_WHEEL_SLOTS 8
+#endif
+
+#define WHEEL_MASK (SOFT_TIMER_WHEEL_SLOTS - 1)
+
+#if SOFT_TIMER_WHEEL_SLOTS & WHEEL_MASK
+#error "SOFT_TIMER_WHEEL_SLOTS must be a power of two"
+#endif
+
+#define NO_TIMER 0xFF
+
+// set while the timer is on the wheel
+#define SOFT_TIMER_ACTIVE 0x80
+
+struct soft_timer {
+	voidFuncPtr callback;
+	unsigned int period;          // 0 for one-shot timers
+	unsigned int laps;            // trips round the wheel still to wait
+	uint8_t slot;
+	uint8_t next;
+	uint8_t prev;
+	uint8_t flags;
+};
+
+static struct soft_timer timers[SOFT_TIMER_COUNT];
+static uint8_t wheel[SOFT_TIMER_WHEEL_SLOTS] = { [0 ... WHEEL_MASK] = NO_TIMER };
+static uint8_t wheel_pos;
+
+// deferred timers that have expired but not been dispatched
+static volatile uint8_t soft_timer_pending;
+
+// timers that expired this tick and whose callbacks haven't run yet
+static uint8_t soft_timer_expired;
+
+// These two are only called with interrupts off.
+static void wheel_insert(uint8_t id, unsigned int ticks)
+{
+	struct soft_timer *t = &timers[id];
+	uint8_t slot = (wheel_pos + ticks) & WHEEL_MASK;
+
+	t->laps = (ticks - 1) / SOFT_TIMER_WHEEL_SLOTS;
+	t->slot = slot;
+	t->prev = NO_TIMER;
+	t->next = wheel[slot];
+	if (t->next != NO_TIMER)
+		timers[t->next].prev = id;
+	wheel[slot] = id;
+}
+
+static void wheel_remove(uint8_t id)
+{
+	struct soft_timer *t = &timers[id];
+
+	if (t->prev == NO_TIMER)
+		wheel[t->slot] = t->next;
+	else
+		timers[t->prev].next = t->next;
+	if (t->next != NO_TIMER)
+		timers[t->next].prev = t->prev;
+}
+
+void softTimerStart(uint8_t id, unsigned int ticks, uint8_t flags,
+		    voidFuncPtr callback)
+{
+	struct soft_timer *t;
+	uint8_t oldSREG;
+
+	if (id >= SOFT_TIMER_COUNT) return;
+	t = &timers[id];
+	if (ticks == 0) ticks = 1;
+
+	oldSREG = SREG;
+	cli();
+
+	if (t->flags & SOFT_TIMER_ACTIVE)
+		wheel_remove(id);
+	soft_timer_pending &= ~_BV(id);
+	soft_timer_expired &= ~_BV(id);
+
+	t->callback = callback;
+	t->period = (flags & SOFT_TIMER_PERIODIC) ? ticks : 0;
+	t->flags = (flags & SOFT_TIMER_DEFERRED) | SOFT_TIMER_ACTIVE;
+	wheel_insert(id, ticks);
+
+	SREG = oldSREG;
+}
+
+void softTimerStop(uint8_t id)
+{
+	struct soft_timer *t;
+	uint8_t oldSREG;
+
+	if (id >= SOFT_TIMER_COUNT) return;
+	t = &timers[id];
+
+	oldSREG = SREG;
+	cli();
+
+	if (t->flags & SOFT_TIMER_ACTIVE)
+		wheel_remove(id);
+	t->flags &= ~SOFT_TIMER_ACTIVE;
+	soft_timer_pending &= ~_BV(id);
+	soft_timer_expired &= ~_BV(id);
+
+	SREG = oldSREG;
+}
+
+uint8_t softTimerActive(uint8_t id)
+{
+	if (id >= SOFT_TIMER_COUNT) return 0;
+
+	return !!(timers[id].flags & SOFT_TIMER_ACTIVE);
+}
+
+// Called from the timer 0 overflow interrupt.  Expired timers are
+// collected first and their callbacks run after the wheel walk, so a
+// callback may start or stop any timer, itself included.  One that is
+// stopped or restarted that way before its turn doesn't get called.
+void softTimerTick(void)
+{
+	uint8_t id, next, bit;
+
+	wheel_pos = (wheel_pos + 1) & WHEEL_MASK;
+
+	for (id = wheel[wheel_pos]; id != NO_TIMER; id = next) {
+		struct soft_timer *t = &timers[id];
+
+		next = t->next;
+		if (t->laps) {
+			t->laps--;
+			continue;
+		}
+
+		wheel_remove(id);
+		if (t->period)
+			wheel_insert(id, t->period);
+		else
+			t->flags &= ~SOFT_TIMER_ACTIVE;
+		soft_timer_expired |= _BV(id);
+	}
+
+	for (id = 0, bit = 1; soft_timer_expired; id++, bit <<= 1) {
+		if (!(soft_timer_expired & bit)) continue;
+		soft_timer_expired &= ~bit;
+
+		if (timers[id].flags & SOFT_TIMER_DEFERRED)
+			soft_timer_pending |= bit;
+		else
+			timers[id].callback();
+	}
+}
+
+// Run the callbacks of deferred timers that have expired since the
+// last call.  main() calls this after every loop(); a sketch that
+// spends a long time inside loop() can call it too.  Each timer's
+// bit is taken as it comes up, so a callback that stops a timer
+// further on keeps that one from being called.
+void softTimerDispatch(void)
+{
+	uint8_t id, bit, run;
+	uint8_t oldSREG = SREG;
+
+	for (id = 0, bit = 1; id < SOFT_TIMER_COUNT; id++, bit <<= 1) {
+		cli();
+		run = soft_timer_pending & bit;
+		soft_timer_pending &= ~bit;
+		SREG = oldSREG;
+
+		if (run)
+			timers[id].callback();
+	}
+}
+
+#endif